@@ -3,16 +3,23 @@ uniform sampler2D tex0;
 uniform sampler2D norm_tex;
 uniform sampler2D tex2;         //Take in 2nd texture
 
-uniform vec3 lightPos;
-uniform vec3 lightColor;
-uniform vec3 playerFacing;      //Direction player is facing
-
-uniform float ambientStr;
-uniform vec3 ambientColor;
-
-uniform vec3 cameraPos;
-uniform float specStr;
-uniform float specPhong;
+//Per frame camera, shared by every program (binding 0)
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    vec3 cameraPos;
+};
+
+//Active light, updated once a frame (binding 1)
+layout(std140) uniform LightData {
+    vec3 lightPos;
+    float ambientStr;
+    vec3 lightColor;
+    float specStr;
+    vec3 ambientColor;
+    float specPhong;
+    vec3 playerFacing;          //Direction player is facing
+};
 
 uniform int blendMode;
 uniform int lightingMode;
@@ -39,8 +46,9 @@ void main()
     //vec3 normal = normalize(normCoord);   //Regular normals w/o bump
     
     //NORMAL MAP
-    vec3 normal = texture(norm_tex, texCoord).rgb;
-    normal = normalize(normal * 2.0 - 1.0);         //Converts rgb (0 to 1) into xyz (-1 to 1)
+    vec3 normal;
+    normal.xy = texture(norm_tex, texCoord).rg * 2.0 - 1.0;    //Converts rg (0 to 1) into xy (-1 to 1)
+    normal.z = sqrt(max(1.0 - dot(normal.xy, normal.xy), 0.0)); //Rebuilt since BC5 normal maps only keep X and Y
     normal = normalize(TBN * normal);
     
     
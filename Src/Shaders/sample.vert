@@ -5,41 +5,76 @@
 layout(location = 0) in vec3 aPos; 
 layout(location = 1) in vec3 vertexNormal;
 layout(location = 2) in vec2 aTex;
-layout(location = 3) in vec3 m_tan;
+layout(location = 3) in vec4 m_tan;     //w = bitangent handedness, 1 for float meshes
 layout(location = 4) in vec3 m_btan;
+layout(location = 5) in vec4 instance;  //Instanced draws: xyz position, w uniform scale
 
 out vec2 texCoord;
 out vec3 normCoord;
 out vec3 fragPos;
 out mat3 TBN;       //Tan to obj space
 
-//Create MVP matrices
+//Model matrix per object, view and projection per frame
 uniform mat4 transform;
-uniform mat4 projection;
-uniform mat4 view;
+uniform bool instanced;     //Build the model matrix from the instance attribute instead
+
+//Per frame camera, shared by every program (binding 0)
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    vec3 cameraPos;
+};
+
+//Packed meshes: aPos is 0-1 inside the mesh bounds and vertexNormal.xy is octahedral
+uniform bool packedVertex;
+uniform vec3 boundsMin;
+uniform vec3 boundsExtent;
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
 
 
 void main()
 {
+    vec3 position = aPos;
+    vec3 normal = vertexNormal;
+    if (packedVertex) {
+        position = boundsMin + aPos * boundsExtent;
+        normal = octDecode(vertexNormal.xy);
+    }
+
+    mat4 model = transform;
+    if (instanced)
+        model = mat4(vec4(instance.w, 0.0, 0.0, 0.0),
+                     vec4(0.0, instance.w, 0.0, 0.0),
+                     vec4(0.0, 0.0, instance.w, 0.0),
+                     vec4(instance.xyz, 1.0));
+
     //transform then view then projection
-    gl_Position = projection * view * transform * //Multiply the matrix with the position
-                    vec4(aPos, 1.0); // Turns our 3x1 matrix into a 4x1
+    gl_Position = projection * view * model * //Multiply the matrix with the position
+                    vec4(position, 1.0); // Turns our 3x1 matrix into a 4x1
 
     texCoord = aTex;
 
     
-    mat3 modelMat = mat3(transpose(inverse(transform)));
-    normCoord =  modelMat * vertexNormal;
+    mat3 modelMat = mat3(transpose(inverse(model)));
+    normCoord =  modelMat * normal;
 
     //Tangent light
-    vec3 T = normalize(modelMat * m_tan);
+    vec3 T = normalize(modelMat * m_tan.xyz);
     //vec3 B = normalize(modelMat * m_btan);
     vec3 N = normalize(normCoord);
 
     T = normalize(T - dot(T, N) * N);   //Same as vec3 B but Gram-Schmidt Process
-    vec3 B = cross(N, T);
+    vec3 B = cross(N, T) * m_tan.w;
 
     TBN = mat3(T, B, N);
 
-    fragPos = vec3(transform * vec4(aPos, 1.0));
+    fragPos = vec3(model * vec4(position, 1.0));
 }
\ No newline at end of file
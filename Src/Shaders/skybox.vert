@@ -6,14 +6,18 @@ layout(location = 0) in vec3 aPos;
 
 out vec3 texCoord;
 
-uniform mat4 projection;
-uniform mat4 view;
+//Per frame camera, shared by every program (binding 0)
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    vec3 cameraPos;
+};
 
 
 
 void main()
 {
-    vec4 pos = projection * view * 
+    vec4 pos = projection * mat4(mat3(view)) *     //Drop the translation so the sky stays around the camera
                     vec4(aPos, 1.0); // Turns our 3x1 matrix into a 4x1
 
     //Write on view space. 1 = view space = w
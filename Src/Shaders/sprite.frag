@@ -0,0 +1,20 @@
+#version 330 core //Version
+uniform sampler2D tex0;     //Same base texture as the mesh so the switch isn't noticeable
+
+in vec2 corner;
+in vec4 tint;
+
+out vec4 FragColor; //Returns a Color
+
+void main()
+{
+    float r2 = dot(corner, corner);
+    if (r2 > 1.0)
+        discard;    //Round sprite
+
+    //Facing hemisphere of a sphere, wrapped with the same spherical UVs as the planet mesh
+    vec3 normal = vec3(corner, sqrt(1.0 - r2));
+    vec2 uv = vec2(atan(normal.x, normal.z) / 6.2831853 + 0.5, asin(normal.y) / 3.1415927 + 0.5);
+
+    FragColor = texture(tex0, uv) * tint;
+}
\ No newline at end of file
@@ -0,0 +1,26 @@
+#version 330 core //Version Number
+
+//One sprite per instance. The 4 corners of its quad come from gl_VertexID (triangle strip)
+layout(location = 0) in vec4 sprite;    //xyz center, w radius in world units
+layout(location = 1) in vec4 color;     //Tint, alpha below 1 is blended
+
+out vec2 corner;    //-1 to 1 across the quad
+out vec4 tint;
+
+//Per frame camera, shared by every program (binding 0)
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    vec3 cameraPos;
+};
+
+void main()
+{
+    corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+    tint = color;
+
+    //Offset in view space so the quad always faces the camera
+    vec4 viewPos = view * vec4(sprite.xyz, 1.0);
+    viewPos.xy += corner * sprite.w;
+    gl_Position = projection * viewPos;
+}
\ No newline at end of file
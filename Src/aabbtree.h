@@ -0,0 +1,432 @@
+#ifndef AABB_TREE_FILE
+#define AABB_TREE_FILE
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+#define NULL_NODE -1
+#define AABB_MIN_MARGIN 0.05f       //Smallest amount a proxy's bounds are fattened by
+#define AABB_FAT_RATIO 0.1f         //Fattening as a fraction of the object's size. Keeps big and tiny objects equally lazy
+#define AABB_DISPLACEMENT_MULTIPLIER 2.f    //How far ahead the bounds stretch in the direction of motion
+
+//Axis aligned bounding box
+struct AABB {
+    glm::vec3 lower = glm::vec3(0.f);
+    glm::vec3 upper = glm::vec3(0.f);
+
+    bool contains(const AABB& other) const {
+        return glm::all(glm::lessThanEqual(lower, other.lower)) && glm::all(glm::greaterThanEqual(upper, other.upper));
+    }
+
+    bool overlaps(const AABB& other) const {
+        return glm::all(glm::lessThanEqual(lower, other.upper)) && glm::all(glm::greaterThanEqual(upper, other.lower));
+    }
+
+    //Surface area. Cost used when picking where to insert
+    float area() const {
+        glm::vec3 d = upper - lower;
+        return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    static AABB merge(const AABB& a, const AABB& b) {
+        AABB result;
+        result.lower = glm::min(a.lower, b.lower);
+        result.upper = glm::max(a.upper, b.upper);
+        return result;
+    }
+
+    static AABB fromSphere(glm::vec3 center, float radius) {
+        AABB result;
+        result.lower = center - radius;
+        result.upper = center + radius;
+        return result;
+    }
+};
+
+struct TreeNode {
+    AABB box;           //Fattened bounds for leaves, union of children for branches
+    int userData = -1;  //Caller's index for the object in a leaf
+    int parent = NULL_NODE;     //Doubles as the next free node while in the free list
+    int child1 = NULL_NODE;
+    int child2 = NULL_NODE;
+    int height = -1;    //Leaf = 0, free node = -1
+    bool moved = false; //Reinserted since the last pair update
+
+    bool isLeaf() const {
+        return child1 == NULL_NODE;
+    }
+};
+
+//Incremental AABB tree. Leaves hold fattened bounds so small movements don't touch the tree,
+//and AVL style rotations keep it balanced as proxies are inserted and removed.
+class DynamicTree {
+public:
+    std::vector<TreeNode> nodes;
+    int root = NULL_NODE;
+    int freeList = NULL_NODE;
+
+    //Adds an object to the tree
+    // @param box - Tight bounds of the object
+    // @param userData - Caller's index for the object
+    // @return Proxy id used to move or destroy it
+    int createProxy(const AABB& box, int userData) {
+        int proxyId = allocateNode();
+        nodes[proxyId].box = fatten(box, glm::vec3(0.f));
+        nodes[proxyId].userData = userData;
+        nodes[proxyId].height = 0;
+        nodes[proxyId].moved = true;
+        insertLeaf(proxyId);
+        return proxyId;
+    }
+
+    void destroyProxy(int proxyId) {
+        removeLeaf(proxyId);
+        freeNode(proxyId);
+    }
+
+    //Updates an object's bounds. The tree is only touched when the object leaves its fattened bounds
+    // @param box - New tight bounds
+    // @param displacement - Movement since the last update. Stretches the new fat bounds ahead of the object
+    // @return True when the proxy was reinserted
+    bool moveProxy(int proxyId, const AABB& box, glm::vec3 displacement) {
+        const AABB& treeBox = nodes[proxyId].box;
+        if (treeBox.contains(box)) {
+            //Still inside. Only refit when the fat bounds became far bigger than needed (object slowed down)
+            AABB huge = fatten(box, displacement);
+            float slack = 4.f * margin(box);
+            huge.lower -= slack;
+            huge.upper += slack;
+            if (huge.contains(treeBox))
+                return false;
+        }
+
+        removeLeaf(proxyId);
+        nodes[proxyId].box = fatten(box, displacement);
+        insertLeaf(proxyId);
+        nodes[proxyId].moved = true;
+        return true;
+    }
+
+    //Calls callback(proxyId) for every leaf overlapping the box. Return false from the callback to stop
+    template <typename Func>
+    void query(const AABB& box, Func callback) const {
+        if (root == NULL_NODE)
+            return;
+
+        int fixedStack[256];        //Balanced trees rarely need more. Deeper ones move to the heap
+        std::vector<int> heapStack;
+        int* stack = fixedStack;
+        int capacity = 256;
+        int top = 0;
+        stack[top++] = root;
+        while (top > 0) {
+            int index = stack[--top];
+            const TreeNode& node = nodes[index];
+            if (!node.box.overlaps(box))
+                continue;
+
+            if (node.isLeaf()) {
+                if (!callback(index))
+                    return;
+            }
+            else {
+                if (top + 2 > capacity) {
+                    if (stack == fixedStack)
+                        heapStack.assign(fixedStack, fixedStack + top);
+                    capacity *= 2;
+                    heapStack.resize(capacity);
+                    stack = heapStack.data();
+                }
+                stack[top++] = node.child1;
+                stack[top++] = node.child2;
+            }
+        }
+    }
+
+    const AABB& getFatAABB(int proxyId) const {
+        return nodes[proxyId].box;
+    }
+
+    int getUserData(int proxyId) const {
+        return nodes[proxyId].userData;
+    }
+
+    //Points a proxy at a new index after the caller's storage was reordered
+    void setUserData(int proxyId, int userData) {
+        nodes[proxyId].userData = userData;
+    }
+
+    int getHeight() const {
+        return root == NULL_NODE ? 0 : nodes[root].height;
+    }
+
+private:
+    //Fattening for a box, relative to the object's size
+    static float margin(const AABB& box) {
+        glm::vec3 size = box.upper - box.lower;
+        return std::max(AABB_MIN_MARGIN, AABB_FAT_RATIO * std::max(size.x, std::max(size.y, size.z)));
+    }
+
+    //Grows tight bounds by the margin plus the predicted motion
+    static AABB fatten(const AABB& box, glm::vec3 displacement) {
+        float r = margin(box);
+        AABB fat;
+        fat.lower = box.lower - r;
+        fat.upper = box.upper + r;
+
+        glm::vec3 d = AABB_DISPLACEMENT_MULTIPLIER * displacement;
+        fat.lower += glm::min(d, glm::vec3(0.f));
+        fat.upper += glm::max(d, glm::vec3(0.f));
+        return fat;
+    }
+
+    int allocateNode() {
+        if (freeList == NULL_NODE) {
+            nodes.push_back(TreeNode());
+            return (int)nodes.size() - 1;
+        }
+        int index = freeList;
+        freeList = nodes[index].parent;
+        nodes[index] = TreeNode();
+        return index;
+    }
+
+    void freeNode(int index) {
+        nodes[index].parent = freeList;
+        nodes[index].height = -1;
+        freeList = index;
+    }
+
+    void insertLeaf(int leaf) {
+        if (root == NULL_NODE) {
+            root = leaf;
+            nodes[root].parent = NULL_NODE;
+            return;
+        }
+
+        //Find the best sibling by surface area cost
+        AABB leafBox = nodes[leaf].box;
+        int index = root;
+        while (!nodes[index].isLeaf()) {
+            int child1 = nodes[index].child1;
+            int child2 = nodes[index].child2;
+
+            float area = nodes[index].box.area();
+            float combinedArea = AABB::merge(nodes[index].box, leafBox).area();
+
+            float cost = 2.f * combinedArea;                    //Cost of a new parent for this node and the leaf
+            float inheritanceCost = 2.f * (combinedArea - area);    //Minimum cost of pushing the leaf further down
+
+            float cost1 = descendCost(child1, leafBox) + inheritanceCost;
+            float cost2 = descendCost(child2, leafBox) + inheritanceCost;
+
+            if (cost < cost1 && cost < cost2)
+                break;
+            index = cost1 < cost2 ? child1 : child2;
+        }
+        int sibling = index;
+
+        //New parent joins the sibling and the leaf
+        int oldParent = nodes[sibling].parent;
+        int newParent = allocateNode();
+        nodes[newParent].parent = oldParent;
+        nodes[newParent].box = AABB::merge(leafBox, nodes[sibling].box);
+        nodes[newParent].height = nodes[sibling].height + 1;
+        nodes[newParent].child1 = sibling;
+        nodes[newParent].child2 = leaf;
+        nodes[sibling].parent = newParent;
+        nodes[leaf].parent = newParent;
+
+        if (oldParent != NULL_NODE) {
+            if (nodes[oldParent].child1 == sibling)
+                nodes[oldParent].child1 = newParent;
+            else
+                nodes[oldParent].child2 = newParent;
+        }
+        else
+            root = newParent;
+
+        refitUpwards(nodes[leaf].parent);
+    }
+
+    void removeLeaf(int leaf) {
+        if (leaf == root) {
+            root = NULL_NODE;
+            return;
+        }
+
+        int parent = nodes[leaf].parent;
+        int grandParent = nodes[parent].parent;
+        int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+        if (grandParent != NULL_NODE) {
+            //Sibling takes the parent's place
+            if (nodes[grandParent].child1 == parent)
+                nodes[grandParent].child1 = sibling;
+            else
+                nodes[grandParent].child2 = sibling;
+            nodes[sibling].parent = grandParent;
+            freeNode(parent);
+            refitUpwards(grandParent);
+        }
+        else {
+            root = sibling;
+            nodes[sibling].parent = NULL_NODE;
+            freeNode(parent);
+        }
+    }
+
+    //Area added by pushing the leaf down into a child
+    float descendCost(int child, const AABB& leafBox) const {
+        AABB merged = AABB::merge(leafBox, nodes[child].box);
+        if (nodes[child].isLeaf())
+            return merged.area();
+        return merged.area() - nodes[child].box.area();
+    }
+
+    //Rebalances and refits bounds and heights from a node up to the root
+    void refitUpwards(int index) {
+        while (index != NULL_NODE) {
+            index = balance(index);
+
+            int child1 = nodes[index].child1;
+            int child2 = nodes[index].child2;
+            nodes[index].height = 1 + std::max(nodes[child1].height, nodes[child2].height);
+            nodes[index].box = AABB::merge(nodes[child1].box, nodes[child2].box);
+
+            index = nodes[index].parent;
+        }
+    }
+
+    //Rotates node A up or down if its children's heights differ by more than 1
+    // @return Index of the node now at A's position
+    int balance(int iA) {
+        TreeNode* A = &nodes[iA];
+        if (A->isLeaf() || A->height < 2)
+            return iA;
+
+        int iB = A->child1;
+        int iC = A->child2;
+        int balanceFactor = nodes[iC].height - nodes[iB].height;
+
+        if (balanceFactor > 1)
+            return rotateUp(iA, iC, iB);    //Rotate C up
+        if (balanceFactor < -1)
+            return rotateUp(iA, iB, iC);    //Rotate B up
+        return iA;
+    }
+
+    //Promotes the taller child of A. Its shorter grandchild swaps down to A
+    // @param iA - Unbalanced node
+    // @param iUp - Taller child being rotated up
+    // @param iStay - Other child of A
+    int rotateUp(int iA, int iUp, int iStay) {
+        TreeNode& A = nodes[iA];
+        TreeNode& U = nodes[iUp];
+        int iF = U.child1;
+        int iG = U.child2;
+
+        //Swap A and U
+        U.child1 = iA;
+        U.parent = A.parent;
+        A.parent = iUp;
+
+        if (U.parent != NULL_NODE) {
+            if (nodes[U.parent].child1 == iA)
+                nodes[U.parent].child1 = iUp;
+            else
+                nodes[U.parent].child2 = iUp;
+        }
+        else
+            root = iUp;
+
+        //Keep the taller grandchild under U, hand the shorter one to A
+        int iTall = nodes[iF].height > nodes[iG].height ? iF : iG;
+        int iShort = iTall == iF ? iG : iF;
+
+        U.child2 = iTall;
+        if (A.child1 == iUp)
+            A.child1 = iShort;
+        else
+            A.child2 = iShort;
+        nodes[iShort].parent = iA;
+
+        A.box = AABB::merge(nodes[iStay].box, nodes[iShort].box);
+        U.box = AABB::merge(A.box, nodes[iTall].box);
+        A.height = 1 + std::max(nodes[iStay].height, nodes[iShort].height);
+        U.height = 1 + std::max(A.height, nodes[iTall].height);
+        return iUp;
+    }
+};
+
+//Broadphase over the dynamic tree. Keeps a persistent list of overlapping proxy pairs
+//and only re-queries proxies that were reinserted since the last update.
+class BroadPhase {
+public:
+    DynamicTree tree;
+    std::vector<std::pair<int, int> > pairs;    //Overlapping proxy ids (lower id first), sorted
+
+    int createProxy(const AABB& box, int userData) {
+        int proxyId = tree.createProxy(box, userData);
+        moveBuffer.push_back(proxyId);
+        return proxyId;
+    }
+
+    void destroyProxy(int proxyId) {
+        std::replace(moveBuffer.begin(), moveBuffer.end(), proxyId, NULL_NODE);
+        tree.destroyProxy(proxyId);
+
+        //Drop every pair the proxy was part of
+        pairs.erase(std::remove_if(pairs.begin(), pairs.end(), [proxyId](const std::pair<int, int>& p) {
+            return p.first == proxyId || p.second == proxyId;
+        }), pairs.end());
+    }
+
+    void moveProxy(int proxyId, const AABB& box, glm::vec3 displacement) {
+        if (tree.moveProxy(proxyId, box, displacement))
+            moveBuffer.push_back(proxyId);
+    }
+
+    //Refreshes pairs. Pairs between proxies that stayed inside their fat bounds are kept as is
+    void updatePairs() {
+        //New overlaps of the moved proxies
+        newPairs.clear();
+        for (size_t i = 0; i < moveBuffer.size(); i++) {
+            int queryId = moveBuffer[i];
+            if (queryId == NULL_NODE)
+                continue;
+            tree.query(tree.getFatAABB(queryId), [&](int proxyId) {
+                if (proxyId != queryId)
+                    newPairs.push_back(std::make_pair(std::min(proxyId, queryId), std::max(proxyId, queryId)));
+                return true;
+            });
+        }
+        std::sort(newPairs.begin(), newPairs.end());
+        newPairs.erase(std::unique(newPairs.begin(), newPairs.end()), newPairs.end());
+
+        //Old pairs stay valid only if neither side moved. Moved ones were re-queried above
+        const std::vector<TreeNode>& nodes = tree.nodes;
+        pairs.erase(std::remove_if(pairs.begin(), pairs.end(), [&nodes](const std::pair<int, int>& p) {
+            return nodes[p.first].moved || nodes[p.second].moved;
+        }), pairs.end());
+
+        mergedPairs.clear();
+        std::set_union(pairs.begin(), pairs.end(), newPairs.begin(), newPairs.end(), std::back_inserter(mergedPairs));
+        pairs.swap(mergedPairs);
+
+        for (size_t i = 0; i < moveBuffer.size(); i++)
+            if (moveBuffer[i] != NULL_NODE)
+                tree.nodes[moveBuffer[i]].moved = false;
+        moveBuffer.clear();
+    }
+
+private:
+    std::vector<int> moveBuffer;    //Proxies reinserted since the last update
+    std::vector<std::pair<int, int> > newPairs;
+    std::vector<std::pair<int, int> > mergedPairs;
+};
+
+#endif
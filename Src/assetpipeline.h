@@ -0,0 +1,137 @@
+#ifndef ASSET_PIPELINE_FILE
+#define ASSET_PIPELINE_FILE
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <climits>
+#include "parallel.h"
+
+//Decodes assets on a pool of worker threads and queues the finished CPU buffers for the GL thread.
+//Only the thread owning the GL context may call processUploads() and finish()
+class AssetPipeline {
+public:
+    ~AssetPipeline() { stop(); }
+
+    //Starts the workers. With 0 threads submitted work runs inline
+    // @param threads - Number of decode threads
+    void start(int threads = workerCount()) {
+        stop();
+        stopping = false;
+        for (int i = 0; i < threads; i++)
+            workers.push_back(std::thread(&AssetPipeline::workerLoop, this));
+    }
+
+    //Lets the workers finish what they have and joins them. Queued uploads are kept
+    void stop() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        jobReady.notify_all();
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+        workers.clear();
+    }
+
+    //Queues an asset
+    // @param work - Runs on a worker. Must not touch GL
+    // @param upload - Runs on the GL thread after work is done
+    void submit(std::function<void()> work, std::function<void()> upload) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            unfinished++;
+            if (!workers.empty()) {
+                Job job = { work, upload };
+                jobs.push_back(job);
+            }
+        }
+        if (workers.empty()) {
+            work();
+            std::lock_guard<std::mutex> guard(lock);
+            uploads.push_back(upload);
+            return;
+        }
+        jobReady.notify_one();
+    }
+
+    //Runs the uploads that are ready. Call once a frame from the GL thread
+    // @param maxUploads - Spreads big batches over several frames
+    // @returns Number of uploads done
+    int processUploads(int maxUploads = INT_MAX) {
+        int done = 0;
+        while (done < maxUploads) {
+            std::function<void()> upload;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if (uploads.empty())
+                    break;
+                upload = uploads.front();
+                uploads.pop_front();
+            }
+            upload();
+            done++;
+            std::lock_guard<std::mutex> guard(lock);
+            unfinished--;
+        }
+        return done;
+    }
+
+    //Blocks until everything submitted is decoded and uploaded. Uploads run as soon as they arrive
+    void finish() {
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                uploadReady.wait(guard, [this] { return unfinished == 0 || !uploads.empty(); });
+                if (unfinished == 0)
+                    return;
+            }
+            processUploads();
+        }
+    }
+
+    //True when nothing is decoding or waiting for upload
+    bool idle() {
+        std::lock_guard<std::mutex> guard(lock);
+        return unfinished == 0;
+    }
+
+private:
+    struct Job {
+        std::function<void()> work, upload;
+    };
+
+    std::vector<std::thread> workers;
+    std::deque<Job> jobs;
+    std::deque<std::function<void()>> uploads;
+    std::mutex lock;
+    std::condition_variable jobReady, uploadReady;
+    int unfinished = 0;     //Submitted but not uploaded yet
+    bool stopping = false;
+
+    void workerLoop() {
+        onWorkerThread() = true;    //Decoders split their own work inline, the pool belongs to the main thread
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                jobReady.wait(guard, [this] { return stopping || !jobs.empty(); });
+                if (jobs.empty())
+                    return;     //Stopping and drained
+                job = jobs.front();
+                jobs.pop_front();
+            }
+            job.work();
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                uploads.push_back(job.upload);
+            }
+            uploadReady.notify_one();
+        }
+    }
+};
+
+#endif
@@ -31,12 +31,12 @@ void keyboard(GLFWwindow* window, int key, int scancode, int action, int mods) {
             break;
         case GLFW_KEY_5:
             //projectileType = COIL;
-            projectileType = BASIC_SPRING;
+            projectileType = FLUID;
             isSwitched = 1;
             break;
         case GLFW_KEY_6:
             //projectileType = FIREWORK;
-            projectileType = ANCHORED_SPRING;
+            projectileType = SOFT_BODY;
             isSwitched = 1;
             break;
         case GLFW_KEY_7:
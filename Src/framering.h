@@ -0,0 +1,160 @@
+#ifndef FRAME_RING_FILE
+#define FRAME_RING_FILE
+
+#include <glad/glad.h>
+#include <vector>
+#include <cstdint>
+
+#define FRAME_RING_FRAMES 3             //Frames the CPU may run ahead of the GPU
+#define FRAME_RING_BYTES (1 << 20)      //Starting space per frame, grown when a frame needs more
+#define FRAME_RING_ALIGN 16             //Default alignment of an allocation
+#define FRAME_RING_WAIT_NS 1000000      //Fence poll interval when the next frame's partition is busy
+
+//One buffer split into a partition per frame in flight for data rewritten every frame.
+//With GL 4.4 or ARB_buffer_storage it is persistently and coherently mapped, so callers write
+//straight into GPU visible memory and nothing is reallocated or copied. A fence per partition
+//keeps the CPU off a partition the GPU may still be reading.
+//Without buffer storage, writes go to a client copy that commit() sends with glBufferSubData
+class FrameRingBuffer {
+public:
+    GLuint buffer = 0;
+    unsigned char* mapped = NULL;
+    size_t frameSize = 0;                   //Bytes in each partition
+    bool persistent = false;
+    int stalls = 0, grows = 0;              //Waits on a busy partition, reallocations for a frame that didn't fit
+
+    // @param bytesPerFrame - Space each frame starts with
+    void create(size_t bytesPerFrame = FRAME_RING_BYTES) {
+        frameSize = bytesPerFrame > FRAME_RING_ALIGN ? bytesPerFrame : FRAME_RING_ALIGN;
+        for (int i = 0; i < FRAME_RING_FRAMES; i++)
+            fences[i] = 0;
+        frame = 0;
+        cursor = 0;
+        allocateStorage();
+    }
+
+    //Moves to the next partition, waiting for the GPU to finish the frame that last used it
+    void beginFrame() {
+        frame = (frame + 1) % FRAME_RING_FRAMES;
+        cursor = 0;
+        GLsync fence = fences[frame];
+        if (fence) {
+            GLenum state = glClientWaitSync(fence, 0, 0);
+            if (state == GL_TIMEOUT_EXPIRED) {
+                stalls++;
+                while (state == GL_TIMEOUT_EXPIRED)
+                    state = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FRAME_RING_WAIT_NS);
+            }
+            glDeleteSync(fence);
+            fences[frame] = 0;
+        }
+    }
+
+    //Reserves space in this frame's partition, valid until endFrame. When the frame is full the ring is
+    //reallocated bigger: read buffer after the call, and earlier pointers this frame must not be written again
+    // @param bytes - Size of the data
+    // @param offset - Receives the offset of the space inside buffer
+    // @param alignment - Power of two the offset is a multiple of
+    // @returns Where to write the data
+    void* allocate(size_t bytes, GLintptr& offset, size_t alignment = FRAME_RING_ALIGN) {
+        size_t start = (cursor + alignment - 1) & ~(alignment - 1);
+        if (start + bytes > frameSize) {
+            grow(start + bytes);
+            start = 0;
+        }
+        cursor = start + bytes;
+        offset = (GLintptr)(frameSize * frame + start);
+        return (persistent ? mapped : shadow.data()) + offset;
+    }
+
+    //Makes an allocation visible to the GPU. Nothing to do when the mapping is coherent
+    void commit(GLintptr offset, size_t bytes) {
+        if (persistent || bytes == 0)
+            return;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, offset, (GLsizeiptr)bytes, shadow.data() + offset);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    //Fences the partition once every draw reading it has been issued
+    void endFrame() {
+        if (persistent)
+            fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        if (!retired.empty()) {
+            glDeleteBuffers((GLsizei)retired.size(), retired.data());   //Draws already issued keep them alive
+            retired.clear();
+        }
+    }
+
+    void destroy() {
+        releaseStorage(false);
+        if (!retired.empty())
+            glDeleteBuffers((GLsizei)retired.size(), retired.data());
+        retired.clear();
+        shadow.clear();
+    }
+
+private:
+    GLsync fences[FRAME_RING_FRAMES] = { 0 };
+    int frame = 0;
+    size_t cursor = 0;                      //Bytes used in the current partition
+    std::vector<unsigned char> shadow;      //Client copy when not persistently mapped
+    std::vector<GLuint> retired;            //Outgrown buffers this frame's draws may still use
+
+    void allocateStorage() {
+        size_t total = frameSize * FRAME_RING_FRAMES;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        persistent = false;
+        if (GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_COPY_WRITE_BUFFER, (GLsizeiptr)total, NULL, flags);
+            mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, (GLsizeiptr)total, flags);
+            persistent = mapped != NULL;
+            if (!persistent) {
+                glDeleteBuffers(1, &buffer);    //Storage is immutable, start over with a plain buffer
+                glGenBuffers(1, &buffer);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            }
+        }
+        if (!persistent) {
+            glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)total, NULL, GL_STREAM_DRAW);
+            shadow.assign(total, 0);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    //Unmaps and drops the buffer. Keeps it for endFrame when draws this frame may reference it
+    void releaseStorage(bool keepForFrame) {
+        for (int i = 0; i < FRAME_RING_FRAMES; i++)
+            if (fences[i]) {
+                glDeleteSync(fences[i]);
+                fences[i] = 0;
+            }
+        if (buffer) {
+            if (mapped) {
+                glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+                glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            }
+            if (keepForFrame)
+                retired.push_back(buffer);
+            else
+                glDeleteBuffers(1, &buffer);
+        }
+        buffer = 0;
+        mapped = NULL;
+    }
+
+    //Replaces the ring with one whose partitions fit at least needed bytes.
+    //The new buffer has nothing in flight, so the old fences are dropped
+    void grow(size_t needed) {
+        while (frameSize < needed)
+            frameSize *= 2;
+        releaseStorage(true);
+        allocateStorage();
+        grows++;
+    }
+};
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef FRUSTUM_CULL_FILE
+#define FRUSTUM_CULL_FILE
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cmath>
+#include "simd.h"
+
+//The 6 clip planes of a camera: left, right, bottom, top, near, far.
+//A point p is inside a plane when dot(plane.xyz, p) + plane.w >= 0
+struct Frustum {
+    glm::vec4 planes[6];
+};
+
+//Planes straight from the combined matrix (Gribb & Hartmann). Works for perspective and orthographic
+// @param viewProjection - projection * view
+inline Frustum extractFrustum(const glm::mat4& viewProjection) {
+    glm::vec4 rows[4];
+    for (int r = 0; r < 4; r++)
+        rows[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+
+    Frustum frustum;
+    for (int axis = 0; axis < 3; axis++) {
+        frustum.planes[axis * 2] = rows[3] + rows[axis];
+        frustum.planes[axis * 2 + 1] = rows[3] - rows[axis];
+    }
+    for (int p = 0; p < 6; p++) {
+        float length = glm::length(glm::vec3(frustum.planes[p]));
+        if (length > 0.f)
+            frustum.planes[p] /= length;    //Unit normals so the distance compares against radii
+    }
+    return frustum;
+}
+
+//Bounding spheres in SoA arrays so 4 spheres fill one SSE register. ids[] maps back to the caller's index
+struct BoundingSpheres {
+    std::vector<float> x, y, z, radius;
+    std::vector<int> ids;
+
+    void clear() {
+        x.clear(); y.clear(); z.clear(); radius.clear();
+        ids.clear();
+    }
+
+    void push(int id, const glm::vec3& center, float r) {
+        x.push_back(center.x); y.push_back(center.y); z.push_back(center.z);
+        radius.push_back(r);
+        ids.push_back(id);
+    }
+
+    int size() const { return (int)ids.size(); }
+};
+
+//Tests every sphere against the 6 planes and keeps the ones not fully outside one of them
+// @param visible - Receives the slots (array positions, ids[] has the caller's index) of the visible spheres, in order
+// @returns Number of visible spheres
+inline int cullSpheres(const Frustum& frustum, const BoundingSpheres& spheres, std::vector<int>& visible) {
+    int count = spheres.size();
+    visible.resize(count);
+    int kept = 0;
+    int i = 0;
+#if USE_SSE
+    __m128 planes[6][4];
+    for (int p = 0; p < 6; p++)
+        for (int k = 0; k < 4; k++)
+            planes[p][k] = _mm_set1_ps(frustum.planes[p][k]);
+
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(&spheres.x[i]);
+        __m128 y = _mm_loadu_ps(&spheres.y[i]);
+        __m128 z = _mm_loadu_ps(&spheres.z[i]);
+        __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&spheres.radius[i]));
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < 6; p++) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, planes[p][0]), _mm_mul_ps(y, planes[p][1])),
+                _mm_add_ps(_mm_mul_ps(z, planes[p][2]), planes[p][3]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+        }
+
+        int mask = _mm_movemask_ps(inside);
+        for (int lane = 0; lane < 4; lane++) {
+            visible[kept] = i + lane;   //Branchless compaction: always write, advance when visible
+            kept += (mask >> lane) & 1;
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        bool inside = true;
+        for (int p = 0; p < 6 && inside; p++) {
+            const glm::vec4& plane = frustum.planes[p];
+            inside = plane.x * spheres.x[i] + plane.y * spheres.y[i] + plane.z * spheres.z[i] + plane.w >= -spheres.radius[i];
+        }
+        if (inside)
+            visible[kept++] = i;
+    }
+    visible.resize(kept);
+    return kept;
+}
+
+#endif
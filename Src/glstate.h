@@ -0,0 +1,176 @@
+#ifndef GL_STATE_FILE
+#define GL_STATE_FILE
+
+#include <glad/glad.h>
+
+#define GL_STATE_TEXTURE_UNITS 16   //Units whose bindings are shadowed. Higher ones always issue
+
+//Shadow of the GL state the renderer touches most: bound program, VAO, texture units,
+//depth and blend state. A call that would set what is already set is dropped.
+//Only stays correct if every change to the tracked state goes through it, including deletes
+class GLStateCache {
+public:
+    int issued = 0, elided = 0;     //GL calls made and dropped
+
+    void useProgram(GLuint program) {
+        if (track(programValid, program, currentProgram))
+            glUseProgram(program);
+    }
+
+    void bindVertexArray(GLuint VAO) {
+        if (track(vertexArrayValid, VAO, currentVertexArray))
+            glBindVertexArray(VAO);
+    }
+
+    // @param unit - Index, not the GL_TEXTURE0 + n enum
+    void activeTexture(int unit) {
+        if (track(activeUnitValid, (GLuint)unit, activeUnit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    //Binds to the active unit
+    // @param target - GL_TEXTURE_2D and GL_TEXTURE_CUBE_MAP are tracked, anything else always issues
+    void bindTexture(GLenum target, GLuint texture) {
+        int slot = targetSlot(target);
+        if (!activeUnitValid || activeUnit >= GL_STATE_TEXTURE_UNITS || slot < 0) {
+            glBindTexture(target, texture);
+            issued++;
+            if (!activeUnitValid && slot >= 0)
+                for (int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++)
+                    textureValid[unit][slot] = false;   //Unknown unit, any of them may have changed
+            return;
+        }
+        if (track(textureValid[activeUnit][slot], texture, textures[activeUnit][slot]))
+            glBindTexture(target, texture);
+    }
+
+    //Binds to a unit, switching the active unit only when the binding actually changes
+    void bindTexture(int unit, GLenum target, GLuint texture) {
+        int slot = targetSlot(target);
+        if (unit < GL_STATE_TEXTURE_UNITS && slot >= 0 && textureValid[unit][slot] && textures[unit][slot] == texture) {
+            elided++;
+            return;
+        }
+        activeTexture(unit);
+        bindTexture(target, texture);
+    }
+
+    // @param cap - GL_DEPTH_TEST, GL_BLEND and GL_CULL_FACE are tracked, anything else always issues
+    void enable(GLenum cap) { setCapability(cap, true); }
+    void disable(GLenum cap) { setCapability(cap, false); }
+
+    void depthMask(GLboolean flag) {
+        if (track(depthMaskValid, (GLuint)flag, currentDepthMask))
+            glDepthMask(flag);
+    }
+
+    void depthFunc(GLenum func) {
+        if (track(depthFuncValid, func, currentDepthFunc))
+            glDepthFunc(func);
+    }
+
+    void blendFunc(GLenum source, GLenum destination) {
+        if (blendFuncValid && blendSource == source && blendDestination == destination) {
+            elided++;
+            return;
+        }
+        glBlendFunc(source, destination);
+        blendSource = source;
+        blendDestination = destination;
+        blendFuncValid = true;
+        issued++;
+    }
+
+    //Deleting a bound object resets its binding to 0. A recycled name must not look bound
+    void deletedVertexArray(GLuint VAO) {
+        if (currentVertexArray == VAO)
+            vertexArrayValid = false;
+    }
+
+    void deletedTexture(GLuint texture) {
+        for (int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++)
+            for (int slot = 0; slot < 2; slot++)
+                if (textures[unit][slot] == texture)
+                    textureValid[unit][slot] = false;
+    }
+
+    //Forgets everything, for after code that changed state behind the cache's back
+    void invalidate() {
+        programValid = vertexArrayValid = activeUnitValid = false;
+        depthMaskValid = depthFuncValid = blendFuncValid = false;
+        for (int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++)
+            textureValid[unit][0] = textureValid[unit][1] = false;
+        for (int i = 0; i < 3; i++)
+            capabilityValid[i] = false;
+    }
+
+    void resetCounters() {
+        issued = elided = 0;
+    }
+
+private:
+    GLuint currentProgram = 0, currentVertexArray = 0, activeUnit = 0;
+    GLuint textures[GL_STATE_TEXTURE_UNITS][2] = { { 0 } };     //2D and cube map per unit
+    GLuint currentDepthMask = 0, currentDepthFunc = 0;
+    GLenum blendSource = 0, blendDestination = 0;
+    bool capabilities[3] = { false };
+
+    bool programValid = false, vertexArrayValid = false, activeUnitValid = false;
+    bool textureValid[GL_STATE_TEXTURE_UNITS][2] = { { false } };
+    bool depthMaskValid = false, depthFuncValid = false, blendFuncValid = false;
+    bool capabilityValid[3] = { false };
+
+    //Records the new value and reports whether the GL call is needed
+    bool track(bool& valid, GLuint value, GLuint& current) {
+        if (valid && current == value) {
+            elided++;
+            return false;
+        }
+        current = value;
+        valid = true;
+        issued++;
+        return true;
+    }
+
+    static int targetSlot(GLenum target) {
+        switch (target) {
+        case GL_TEXTURE_2D: return 0;
+        case GL_TEXTURE_CUBE_MAP: return 1;
+        default: return -1;
+        }
+    }
+
+    static int capabilitySlot(GLenum cap) {
+        switch (cap) {
+        case GL_DEPTH_TEST: return 0;
+        case GL_BLEND: return 1;
+        case GL_CULL_FACE: return 2;
+        default: return -1;
+        }
+    }
+
+    void setCapability(GLenum cap, bool on) {
+        int slot = capabilitySlot(cap);
+        if (slot >= 0) {
+            if (capabilityValid[slot] && capabilities[slot] == on) {
+                elided++;
+                return;
+            }
+            capabilities[slot] = on;
+            capabilityValid[slot] = true;
+        }
+        if (on)
+            glEnable(cap);
+        else
+            glDisable(cap);
+        issued++;
+    }
+};
+
+//The one context's state, shared by every module that binds
+inline GLStateCache& glState() {
+    static GLStateCache state;
+    return state;
+}
+
+#endif
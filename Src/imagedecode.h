@@ -0,0 +1,38 @@
+#ifndef IMAGE_DECODE_FILE
+#define IMAGE_DECODE_FILE
+
+#include <string>
+#include <iostream>
+#ifndef STB_IMAGE_IMPLEMENTATION    //main.cpp already pulled in stb_image with its implementation
+#include "stb_image.h"
+#endif
+
+//Decoded RGBA pixels, freed with the struct
+struct ImageData {
+    unsigned char* pixels = NULL;
+    int width = 0, height = 0;
+
+    ImageData() {}
+    ImageData(const ImageData&) = delete;
+    ImageData& operator=(const ImageData&) = delete;
+    ~ImageData() {
+        if (pixels)
+            stbi_image_free(pixels);    //Frees up the bytes
+    }
+};
+
+//Decodes an image file to RGBA. Safe on any thread, the flip setting is per thread
+// @param path (Only use PNG for consistency) - String of the texture file location
+// @param flip - Flip vertically so row 0 is the bottom (what GL_TEXTURE_2D expects)
+inline bool decodeImage(const std::string& path, bool flip, ImageData& image) {
+    int colorChannel;
+    stbi_set_flip_vertically_on_load_thread(flip);
+    image.pixels = stbi_load(path.c_str(), &image.width, &image.height, &colorChannel, 4);  //Always expand to RGBA
+    if (!image.pixels) {
+        std::cout << "Failed to load " << path << ": " << stbi_failure_reason() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+#endif
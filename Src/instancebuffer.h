@@ -0,0 +1,139 @@
+#ifndef INSTANCE_BUFFER_FILE
+#define INSTANCE_BUFFER_FILE
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "meshcache.h"
+#include "framering.h"
+#include "frustumcull.h"
+#include "occlusion.h"
+#include "sprites.h"
+
+#define INSTANCE_ATTRIBUTE 5        //Vertex attribute holding the per instance data
+
+//One drawn copy of a mesh: translation and uniform scale
+struct InstanceData {
+    glm::vec3 position;
+    float scale;
+};
+
+//Per instance data for drawing many copies of one mesh in a draw call per LOD.
+//Instances are written straight into this frame's part of a FrameRingBuffer, grouped by the level of detail they need
+class InstanceBuffer {
+public:
+    GLuint buffer = 0;                  //Ring buffer the last build wrote to
+    GLintptr offset = 0;                //Where its instances start
+    int total = 0;                      //Instances written by the last build
+    int culled = 0;                     //Active instances the last build left out as off screen
+    int occluded = 0;                   //Visible ones it left out as hidden behind occluders
+    int sprited = 0;                    //Visible ones it handed to the sprite batch
+    int lodFirst[MESH_LOD_MAX] = { 0 }; //Range of each level inside the buffer
+    int lodCount[MESH_LOD_MAX] = { 0 };
+
+    //Writes every active instance inside the frustum and picks each one's LOD.
+    //Instances too small on screen for the mesh go to the sprite batch instead
+    // @param ring - Per frame buffer the instances are written to
+    // @param mesh - Mesh the instances will draw, for its bounds and LOD errors
+    // @param count - Number of candidates
+    // @param instance - Called as instance(i, position, scale). Returns false to skip i
+    // @param frustum - This frame's camera frustum
+    // @param occlusion - Rasterized occluders to test against, NULL to skip the test
+    // @param view - View matrix
+    // @param projection - Projection matrix
+    // @param screenHeight - Viewport height in pixels
+    // @param sprites - Receives instances under SPRITE_SWITCH_PIXELS, NULL to always draw the mesh
+    // @param spriteColor - Tint of those sprites
+    template <typename Source>
+    void build(FrameRingBuffer& ring, const Mesh& mesh, int count, Source instance, const Frustum& frustum,
+        OcclusionBuffer* occlusion, const glm::mat4& view, const glm::mat4& projection, float screenHeight,
+        SpriteBatch* sprites = NULL, const glm::vec4& spriteColor = glm::vec4(1.f)) {
+        //Bounding sphere of every active candidate, then only the visible ones go on
+        spheres.clear();
+        scales.clear();
+        for (int i = 0; i < count; i++) {
+            InstanceData data;
+            if (!instance(i, data.position, data.scale))
+                continue;
+            spheres.push(i, data.position + mesh.center * data.scale, mesh.radius * data.scale);
+            scales.push_back(data.scale);
+        }
+        int visibleCount = cullSpheres(frustum, spheres, visible);
+        culled = spheres.size() - visibleCount;
+        occluded = 0;
+        if (occlusion) {
+            int kept = 0;
+            for (int v = 0; v < visibleCount; v++) {
+                int slot = visible[v];
+                if (occlusion->testSphere(glm::vec3(spheres.x[slot], spheres.y[slot], spheres.z[slot]), spheres.radius[slot]))
+                    visible[kept++] = slot;
+            }
+            occluded = visibleCount - kept;
+            visibleCount = kept;
+        }
+
+        //Count each level so the write pass can place instances directly
+        lodOf.resize(visibleCount);
+        for (int lod = 0; lod < MESH_LOD_MAX; lod++)
+            lodCount[lod] = 0;
+        sprited = 0;
+        for (int v = 0; v < visibleCount; v++) {
+            int slot = visible[v];
+            glm::vec3 center(spheres.x[slot], spheres.y[slot], spheres.z[slot]);
+            glm::vec3 viewCenter = glm::vec3(view * glm::vec4(center, 1.f));
+            if (sprites && projectedRadius(viewCenter, spheres.radius[slot], projection, screenHeight) < SPRITE_SWITCH_PIXELS) {
+                sprites->add(center, spheres.radius[slot], spriteColor);
+                lodOf[v] = -1;
+                sprited++;
+                continue;
+            }
+            lodOf[v] = (signed char)selectLod(mesh, viewCenter, scales[slot], projection, screenHeight);
+            lodCount[lodOf[v]]++;
+        }
+        total = 0;
+        for (int lod = 0; lod < MESH_LOD_MAX; lod++) {
+            lodFirst[lod] = total;
+            total += lodCount[lod];
+        }
+        if (total == 0)
+            return;
+
+        size_t bytes = sizeof(InstanceData) * (size_t)total;
+        InstanceData* mapped = (InstanceData*)ring.allocate(bytes, offset);
+        buffer = ring.buffer;
+        int cursor[MESH_LOD_MAX];
+        for (int lod = 0; lod < MESH_LOD_MAX; lod++)
+            cursor[lod] = lodFirst[lod];
+        for (int v = 0; v < visibleCount; v++) {
+            if (lodOf[v] < 0)
+                continue;   //Drawn as a sprite
+            InstanceData& data = mapped[cursor[lodOf[v]]++];
+            instance(spheres.ids[visible[v]], data.position, data.scale);
+        }
+        ring.commit(offset, bytes);
+    }
+
+    //Points the instance attribute of the bound VAO at the first instance of a level
+    void attach(int lod) const {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glVertexAttribPointer(INSTANCE_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+            (void*)(offset + sizeof(InstanceData) * (size_t)lodFirst[lod]));
+        glVertexAttribDivisor(INSTANCE_ATTRIBUTE, 1);
+        glEnableVertexAttribArray(INSTANCE_ATTRIBUTE);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    //Leaves the bound VAO as the mesh upload made it
+    void detach() const {
+        glDisableVertexAttribArray(INSTANCE_ATTRIBUTE);
+        glVertexAttribDivisor(INSTANCE_ATTRIBUTE, 0);
+    }
+
+private:
+    BoundingSpheres spheres;            //Active candidates
+    std::vector<float> scales;          //Scale of each sphere
+    std::vector<int> visible;           //Sphere slots that passed the frustum test
+    std::vector<signed char> lodOf;     //Level of each visible instance, -1 for sprites
+};
+
+#endif
@@ -17,6 +17,20 @@
 #include "stb_image.h"
 #include "particle.h"       //Particle settings and constants
 #include "controls.h"       //Controls for keyboard and mouse
+#include "spatialquery.h"   //Raycast, radius and nearest queries over particles
+#include "aabbtree.h"       //Dynamic AABB tree broadphase
+#include "morton.h"         //Morton order sorting of particle storage
+#include "sph.h"            //Smoothed particle hydrodynamics solver
+#include "meshcache.h"      //Shared OBJ meshes
+#include "texturecache.h"   //Shared textures
+#include "softbody.h"       //Mass-spring lattices from meshes
+#include "uniforms.h"       //Reflected uniform locations
+#include "uniformbuffer.h"  //Per frame camera and light blocks
+#include "instancebuffer.h" //Per instance positions for instanced draws
+#include "framering.h"      //Persistently mapped per frame buffer
+#include "renderqueue.h"    //Draws sorted by state
+#include "glstate.h"        //Drops redundant binds and toggles
+#include "occlusion.h"      //CPU depth buffer for hiding instances behind nearer ones
 
 #define TIMESTEP 1.0/60.0
 
@@ -35,10 +49,10 @@ public:
     int isConstantForceActive = ACTIVE;     //Constant force toggle
     int isDragForceActive = ACTIVE;         //Drag force toggle
     float initTime, despawnTime; //despawnTime is its lifespan
-    glm::vec3 partPos;  //Position
+    glm::vec3 partPos = glm::vec3(0.f);     //Position. Zeroed so never spawned slots still reorder safely
     glm::vec3 partVel;  //Velocity
     glm::vec3 partAcc;  //Acceleration
-    glm::vec3 forceAccum; //Active forces
+    glm::vec3 forceAccum = glm::vec3(0.f); //Active forces
 
     //Initialize particle variables
     void initParticle(int projType, float scale, float currTime, glm::vec3 startPos) {	//Initialize values for damp, m, v, a, etc.
@@ -56,7 +70,7 @@ public:
         isGravityActive = gravitySettings[projType - 1];
         isConstantForceActive = constantForceSettings[projType - 1];
         isDragForceActive = dragForceSettings[projType - 1];
-        std::cout << "INITIALIZED\n";
+        clearForceAccum();      //Nothing carried over from the slot's last life
     }
 
     //Despawn the particle
@@ -64,7 +78,6 @@ public:
         if (partType) {
             partType = INACTIVE;    //Set type to inactive and will not be rendered in main()
             *particleSlots += 1;    //Restore amount of available slots for particles by 1
-            std::cout << "DESPAWNPART\n";
         }
     }
     
@@ -209,6 +222,37 @@ public:
     }
 };
 
+//Liquid - Pressure and viscosity from neighbouring fluid particles
+//computeForces() solves the whole block once per step, then updateForce() hands each particle its share
+class SPHForce : public ParticleForceGenerator {
+public:
+    SPHSolver solver;
+    Particle* fluid = NULL;     //First particle of the fluid block
+    int fluidCount = 0;
+    std::vector<glm::vec3> positions, velocities;
+    std::vector<float> masses;
+
+    void computeForces(Particle* parts, int count) {
+        fluid = parts;
+        fluidCount = count;
+        positions.resize(count);
+        velocities.resize(count);
+        masses.resize(count);
+        for (int i = 0; i < count; i++) {
+            positions[i] = parts[i].partPos;
+            velocities[i] = parts[i].partVel;
+            masses[i] = parts[i].mass;
+        }
+        solver.step(positions.data(), velocities.data(), masses.data(), count);
+    }
+
+    void updateForce(Particle* part) {
+        int i = (int)(part - fluid);
+        if (i >= 0 && i < fluidCount && part->partType)
+            part->forceAccum += solver.forces[i];
+    }
+};
+
 //Links a Particle to a ParticleForceGenerator's updateForceMethod
 class ForceRegistry {
 public:
@@ -216,6 +260,106 @@ public:
         forceGen->updateForce(part);            //Calculate the force
     }
 };
+
+//Pushes two overlapping spheres apart and bounces them off each other. Immovable particles (mass 0) don't give way
+// @param radiusA - Collision radius of a
+// @param radiusB - Collision radius of b
+inline void resolveContact(Particle& a, Particle& b, float radiusA, float radiusB) {
+    glm::vec3 offset = b.partPos - a.partPos;
+    float distance = glm::length(offset);
+    float overlap = radiusA + radiusB - distance;
+    if (overlap <= 0.f || distance <= 0.f)
+        return;
+    float inverseA = a.mass ? 1.f / a.mass : 0.f;
+    float inverseB = b.mass ? 1.f / b.mass : 0.f;
+    if (inverseA + inverseB == 0.f)
+        return;
+
+    glm::vec3 normal = offset / distance;
+    glm::vec3 correction = normal * (overlap / (inverseA + inverseB));
+    a.partPos -= correction * inverseA;
+    b.partPos += correction * inverseB;
+
+    float approach = glm::dot(b.partVel - a.partVel, normal);
+    if (approach < 0.f) {   //Still closing in
+        float impulse = -(1.f + CONTACT_RESTITUTION) * approach / (inverseA + inverseB);
+        a.partVel -= normal * (impulse * inverseA);
+        b.partVel += normal * (impulse * inverseB);
+    }
+}
+
+//Soft body - Particles at every lattice point joined by BasicSprings
+class SoftBody {
+public:
+    SoftBodyLattice lattice;        //Built with buildLattice()
+    std::vector<Particle> parts;    //One per lattice point
+    std::vector<glm::vec3> points;  //Particle positions for skinning
+    BasicSpring link;               //Reused for every link
+    int pokePoint = 0;              //Particle the user pushes. Follows it through reorders
+
+    void spawn(float currTime) {
+        parts.assign(lattice.points.size(), Particle());
+        for (size_t i = 0; i < parts.size(); i++)
+            parts[i].initParticle(SOFT_BODY, 1.f, currTime, lattice.points[i]);
+        if (lattice.centerPoint >= 0)
+            parts[lattice.centerPoint].mass = 0;    //Pin the core so the body wobbles in place
+    }
+
+    void despawn(int* particleSlots) {
+        for (size_t i = 0; i < parts.size(); i++)
+            parts[i].despawnParticle(particleSlots);
+    }
+
+    bool isActive() {
+        return !parts.empty() && parts[0].partType;
+    }
+
+    //Adds each link's spring force to both of its ends
+    void applySprings(ForceRegistry* registry) {
+        for (size_t i = 0; i < lattice.links.size(); i++) {
+            const SpringLink& spring = lattice.links[i];
+            link.k = spring.k;
+            link.restLength = spring.restLength;
+
+            link.linkOtherEnd(parts[spring.b].partPos);
+            registry->add(&parts[spring.a], &link);
+            link.linkOtherEnd(parts[spring.a].partPos);
+            registry->add(&parts[spring.b], &link);
+        }
+    }
+
+    //Sorts the particles along a Z curve so each spring's ends sit close in memory,
+    //then rewrites every stored point index to match
+    // @param order - Scratch for the permutation
+    // @param skin - Mesh skinned from these particles, its vertex to point map is remapped too
+    void reorder(std::vector<int>& order, SkinnedMesh& skin) {
+        if (parts.empty())
+            return;
+        gatherPositions();
+        mortonOrder(points.data(), (int)points.size(), order);
+        applyPermutation(parts.data(), order);
+        applyPermutation(lattice.points.data(), order);     //Rest positions for the next spawn
+
+        std::vector<int> newIndex;
+        invertOrder(order, newIndex);
+        for (size_t i = 0; i < lattice.links.size(); i++) {
+            lattice.links[i].a = newIndex[lattice.links[i].a];
+            lattice.links[i].b = newIndex[lattice.links[i].b];
+        }
+        remapIndices(lattice.vertexToPoint.data(), (int)lattice.vertexToPoint.size(), order);
+        remapIndices(skin.vertexToPoint.data(), (int)skin.vertexToPoint.size(), order);
+        remapIndices(&lattice.centerPoint, 1, order);
+        remapIndices(&pokePoint, 1, order);
+    }
+
+    //Copies the particle positions out for SkinnedMesh::upload()
+    const std::vector<glm::vec3>& gatherPositions() {
+        points.resize(parts.size());
+        for (size_t i = 0; i < parts.size(); i++)
+            points[i] = parts[i].partPos;
+        return points;
+    }
+};
 //PARTICLE_HW(1/3) END
 
 
@@ -264,6 +408,9 @@ public:
 
 
 
+MeshCache meshCache;        //Every loaded OBJ, shared between Models
+TextureCache textureCache;  //Every loaded image, shared between Models
+
 class Model {
 public:
     float position[3] = { 0.f };
@@ -271,265 +418,59 @@ public:
     float rotation[3] = { 0.f };
     float revolution[3] = { 0.f };
 
-    std::vector<GLfloat> fullVertexData;    //Full vertex data array
-    GLuint VAO, VBO;                        //VAO & VBO
+    Mesh* mesh = NULL;                      //Shared vertex data, VAO & VBO
     glm::mat4 transform;                    //Transform matrix
 
-    GLuint texBase, texNorm, texOverlay;    //3 slots for texture and normal map
+    GLuint texBase = 0, texNorm = 0, texOverlay = 0;    //3 slots for texture and normal map
+    Texture* textures[3] = { NULL, NULL, NULL };        //Shared textures behind the slots
     
-    //Loads 3D object's properties
+    //Loads 3D object's properties. Models loading the same file share one mesh
     // @param fileAddress - String of the 3D obj's location
     void loadObj(std::string fileAddress) {
-        
-        std::string path = fileAddress;     //3D OBJ
-        std::vector<tinyobj::shape_t> shapes;
-        std::vector<tinyobj::material_t> material;
-        std::string warning, error;
-
-        tinyobj::attrib_t attributes;
-
-        bool success = tinyobj::LoadObj(&attributes,
-            &shapes, &material,
-            &warning, &error, path.c_str());
-
-        std::vector<GLuint> mesh_indices;
-        for (int i = 0; i < shapes[0].mesh.indices.size(); i++) {
-            mesh_indices.push_back(shapes[0].mesh.indices[i].vertex_index);
-        }
-
-        //Getting the vectors tan
-        std::vector<glm::vec3> tangents;
-        std::vector<glm::vec3> bitangents;
-
-        //Tangents and bitangents for lighting
-        for (int i = 0; i < shapes[0].mesh.indices.size(); i += 3) {
-            tinyobj::index_t vData1 = shapes[0].mesh.indices[i];
-            tinyobj::index_t vData2 = shapes[0].mesh.indices[i + 1];
-            tinyobj::index_t vData3 = shapes[0].mesh.indices[i + 2];
-
-            //Vertex positions
-            glm::vec3 v1 = glm::vec3(
-                attributes.vertices[(vData1.vertex_index * 3)],
-                attributes.vertices[(vData1.vertex_index * 3) + 1],
-                attributes.vertices[(vData1.vertex_index * 3) + 2]
-            );
-            glm::vec3 v2 = glm::vec3(
-                attributes.vertices[(vData2.vertex_index * 3)],
-                attributes.vertices[(vData2.vertex_index * 3) + 1],
-                attributes.vertices[(vData2.vertex_index * 3) + 2]
-            );
-            glm::vec3 v3 = glm::vec3(
-                attributes.vertices[(vData3.vertex_index * 3)],
-                attributes.vertices[(vData3.vertex_index * 3) + 1],
-                attributes.vertices[(vData3.vertex_index * 3) + 2]
-            );
-
-            //UVs
-            glm::vec2 uv1 = glm::vec2(
-                attributes.texcoords[(vData1.texcoord_index * 2)],
-                attributes.texcoords[(vData1.texcoord_index * 2) + 1]
-            );
-            glm::vec2 uv2 = glm::vec2(
-                attributes.texcoords[(vData2.texcoord_index * 2)],
-                attributes.texcoords[(vData2.texcoord_index * 2) + 1]
-            );
-            glm::vec2 uv3 = glm::vec2(
-                attributes.texcoords[(vData3.texcoord_index * 2)],
-                attributes.texcoords[(vData3.texcoord_index * 2) + 1]
-            );
-
-            glm::vec3 deltaPos1 = v2 - v1;
-            glm::vec3 deltaPos2 = v3 - v1;
-
-            glm::vec2 deltaUV1 = uv2 - uv1;
-            glm::vec2 deltaUV2 = uv3 - uv1;
-
-            float r = 1.0f / ((deltaUV1.x * deltaUV2.y) - (deltaUV1.y * deltaUV2.x));
-
-            glm::vec3 tangent = (deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y) * r;
-            glm::vec3 bitangent = (deltaPos2 * deltaUV1.x - deltaPos1 * deltaUV2.x) * r;
-
-            tangents.push_back(tangent);
-            tangents.push_back(tangent);
-            tangents.push_back(tangent);
-
-            bitangents.push_back(bitangent);
-            bitangents.push_back(bitangent);
-            bitangents.push_back(bitangent);
-        }
-
-        //VERTEX DATA ARRAY
-        //Important data for position XYZ + normals XYZ + UV + tan XYZ + Btan XYZ
-        for (int i = 0; i < shapes[0].mesh.indices.size(); i++) {
-            tinyobj::index_t vData = shapes[0].mesh.indices[i];
-
-            int pos_offset = (vData.vertex_index) * 3;
-            int norm_offset = (vData.normal_index) * 3;
-            int tex_offset = (vData.texcoord_index) * 2;
-            //X Index 0
-            fullVertexData.push_back(
-                attributes.vertices[pos_offset]);
-            //Y Index 1
-            fullVertexData.push_back(
-                attributes.vertices[pos_offset + 1]);
-            //Z Index 2
-            fullVertexData.push_back(
-                attributes.vertices[pos_offset + 2]);
-
-            //normals X Index 3
-            fullVertexData.push_back(
-                attributes.normals[norm_offset]);
-            //normals Y Index 4
-            fullVertexData.push_back(
-                attributes.normals[norm_offset + 1]);
-            //normals Z Index 5
-            fullVertexData.push_back(
-                attributes.normals[norm_offset + 2]);
-
-            //U Index 6
-            fullVertexData.push_back(
-                attributes.texcoords[tex_offset]);
-            //V Index 7
-            fullVertexData.push_back(
-                attributes.texcoords[tex_offset + 1]);
-
-            //Tangents      Index 8,9,10
-            fullVertexData.push_back(tangents[i].x);
-            fullVertexData.push_back(tangents[i].y);
-            fullVertexData.push_back(tangents[i].z);
-            //Bitangents    Index 11,12,13
-            fullVertexData.push_back(bitangents[i].x);
-            fullVertexData.push_back(bitangents[i].y);
-            fullVertexData.push_back(bitangents[i].z);
-        }
+        meshCache.release(mesh);
+        mesh = meshCache.acquire(fileAddress);
     }
     
 
 
-    //Loads and generates opengl textures
+    //Loads and generates opengl textures. Models loading the same file share one texture
     // @param fileAddress (Only use PNG for consistency) - String of the texture file location
     // @param textureIdentifier (0-Base tex, 1-Normal map, 2-Additional) - Identifies which texture is being loaded
     void loadTexture(std::string fileAddress, int textureIdentifier) {
-        int img_width, img_height, colorChannel; //Properties of the texture image
-        stbi_set_flip_vertically_on_load(true);
-        unsigned char* tex_bytes =
-            stbi_load(fileAddress.c_str(), &img_width, &img_height, &colorChannel, 0);
+        if (textureIdentifier < 0 || textureIdentifier > 2)
+            return;     //Only 3 slots
+
+        textureCache.release(textures[textureIdentifier]);
+        textures[textureIdentifier] = textureCache.acquire(fileAddress, textureIdentifier == 1);
 
-        //Switch between which GL_TEXTURE to assign to
+        //Switch between which slot to assign to
         switch (textureIdentifier) {
         case 0:
-            glGenTextures(1, &texBase);
-            glActiveTexture(GL_TEXTURE0);           //Load first texture
-            glBindTexture(GL_TEXTURE_2D, texBase);  //Assign to our base texture slot
+            texBase = textures[0]->id;      //Assign to our base texture slot
             break;
         case 1:
-            glGenTextures(1, &texNorm);
-            glActiveTexture(GL_TEXTURE1);   
-            glBindTexture(GL_TEXTURE_2D, texNorm);  //Assign to our normal map texture slot
+            texNorm = textures[1]->id;      //Assign to our normal map texture slot
             break;
         case 2:
-            glGenTextures(1, &texOverlay);
-            glActiveTexture(GL_TEXTURE2);               //Load as additional texture
-            glBindTexture(GL_TEXTURE_2D, texOverlay);   //Assigned as overlay
-            break;
-        default:
-            glActiveTexture(GL_TEXTURE3);  //Load to an unused 3rd
+            texOverlay = textures[2]->id;   //Assigned as overlay
             break;
         }
-        
-        //May need to allow for switching between clamp or repeat
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);   //GL_CLAMP edge to extend
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);   //GL_REPEAT repeats
-
-        glTexImage2D(GL_TEXTURE_2D,
-            0,          
-            GL_RGBA,    
-            img_width, img_height, 0,
-            GL_RGBA,     
-            GL_UNSIGNED_BYTE,
-            tex_bytes);
-
-        glGenerateMipmap(GL_TEXTURE_2D);  //Mipmaps
-        stbi_image_free(tex_bytes);       //Frees up the bytes
     }
 
-    //Generates the VAO and VBO
-    void generateVAO() {
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-
-        glBindVertexArray(VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(
-            GL_ARRAY_BUFFER,
-            sizeof(GLfloat) * fullVertexData.size(),
-            fullVertexData.data(),
-            GL_DYNAMIC_DRAW
-        );
-
-        //Position
-        glVertexAttribPointer(
-            0,  //Index0 = Pos, Index1 = Color, Index 2 = UV
-            3,  //3 floats: X,Y,Z
-            GL_FLOAT,
-            GL_FALSE,
-            //Number of floats per array
-            14 * sizeof(GLfloat), //14 total: XYZ, normal XYZ, UV, T(x,y,z), Bitan(x,y,z)
-            (void*)0
-        );
-
-        //Normals
-        GLintptr normPtr = 3 * sizeof(GLfloat);
-        glVertexAttribPointer(
-            1, //Index 1
-            3, //3 floats: normal XYZ
-            GL_FLOAT,
-            GL_TRUE, //Yes, normalize
-            14 * sizeof(GLfloat),
-            (void*)normPtr
-        );
-
-        //UV
-        GLintptr uvPtr = 6 * sizeof(GLfloat); //Start offset at Index listed in Vertex Array Data
-        glVertexAttribPointer(
-            2, //Index 2
-            2, //2 floats: U,V
-            GL_FLOAT,
-            GL_FALSE,
-            14 * sizeof(GLfloat),
-            (void*)uvPtr
-        );
-
-        //Tangents
-        GLintptr tangentPtr = 8 * sizeof(GLfloat);
-        glVertexAttribPointer(
-            3,
-            3, //T(x,y,z)
-            GL_FLOAT,
-            GL_FALSE,
-            14 * sizeof(GLfloat),
-            (void*)tangentPtr
-        );
-
-        //Bitangents
-        GLintptr bitangentPtr = 11 * sizeof(GLfloat);
-        glVertexAttribPointer(
-            4,
-            3,  //B(x,y,z)
-            GL_FLOAT,
-            GL_FALSE,
-            14 * sizeof(GLfloat),
-            (void*)bitangentPtr
-        );
+    //Releases the shared mesh and textures
+    void release() {
+        meshCache.release(mesh);
+        mesh = NULL;
+        for (int i = 0; i < 3; i++) {
+            textureCache.release(textures[i]);
+            textures[i] = NULL;
+        }
+        texBase = texNorm = texOverlay = 0;
+    }
 
-        glEnableVertexAttribArray(4);
-        glEnableVertexAttribArray(3);
-        glEnableVertexAttribArray(2);
-        glEnableVertexAttribArray(1);
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    //Generates the VAO and VBO (once per shared mesh)
+    void generateVAO() {
+        meshCache.upload(mesh);
     }
 
     //Calculate transform matrix for revolving around a point
@@ -611,6 +552,7 @@ public:
 class Shader {
 public:
     GLuint shaderProgram;
+    UniformTable uniforms;  //Cached locations and last values of the active uniforms
 
     //Create shader program
     void generateShaderProgram(const char* vertSrc, const char* fragSrc) {
@@ -627,97 +569,97 @@ public:
         glAttachShader(shaderProgram, fragShader);  //Attach compile frag shader
 
         glLinkProgram(shaderProgram);
+        uniforms.reflect(shaderProgram);    //Look every location up once
 
         glDeleteShader(vertShader); //Cleanup shaders
         glDeleteShader(fragShader);
     }
 
-    //Pass the MVP into the shader
-    void passMVP(glm::mat4 transform, glm::mat4 projection, glm::mat4 view) {
-        unsigned int transformLoc = glGetUniformLocation(shaderProgram, "transform");
-        glUniformMatrix4fv(
-            transformLoc,
-            1,
-            GL_FALSE,
-            glm::value_ptr(transform)
-        );
-        unsigned int projectionLoc = glGetUniformLocation(shaderProgram, "projection");
-        glUniformMatrix4fv(
-            projectionLoc,
-            1,
-            GL_FALSE,
-            glm::value_ptr(projection)
-        );
-        unsigned int viewLoc = glGetUniformLocation(shaderProgram, "view");
-        glUniformMatrix4fv(
-            viewLoc,
-            1,
-            GL_FALSE,
-            glm::value_ptr(view)
-        );
+    //Bind the program. The pass functions below write to the bound program
+    void use() {
+        glState().useProgram(shaderProgram);
+    }
+
+    //Pass the model matrix. View and projection come from the FrameData block
+    void passTransform(const glm::mat4& transform) {
+        uniforms.set(UNIFORM_TRANSFORM, transform);
     }
 
     //Pass the textures into the shader
     // @param blendMode - (0-No overlay), (1-Overlay), (2-Multiply)
     void passTextures(GLuint texture, GLuint norm_tex, GLuint tex2, int blendMode) {
-        glActiveTexture(GL_TEXTURE0);
-        GLuint tex0Loc = glGetUniformLocation(shaderProgram, "tex0");
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glUniform1i(tex0Loc, 0);    //Send base texture 0
-
-        glActiveTexture(GL_TEXTURE1);
-        GLuint tex1Loc = glGetUniformLocation(shaderProgram, "norm_tex");
-        glBindTexture(GL_TEXTURE_2D, norm_tex);
-        glUniform1i(tex1Loc, 1);    //Pass texture 1 (normal map)
-
-        glActiveTexture(GL_TEXTURE2);
-        GLuint tex2Loc = glGetUniformLocation(shaderProgram, "tex2");
-        glBindTexture(GL_TEXTURE_2D, tex2);
-        glUniform1i(tex2Loc, 2);    //Pass texture 2 (overlay)
-
-        GLuint blendModeAddress = glGetUniformLocation(shaderProgram, "blendMode");
-        glUniform1i(blendModeAddress, blendMode);   //Pass blend mode
-    }
-
-    //Pass lighting properties to shader
-    // @param isPointLight - Switches shader lighting mode (-1 Spotlight, 0 Unlit, 1 Point light)
-    void passLight(glm::vec3 lightPos, glm::vec3 lightColor, glm::vec3 ambientColor, float ambientStr, float specStr, float specPhong, glm::vec3 cameraPos, int isPointLight, glm::vec3 playerFacing) {
-        //Diffuse
-        GLuint lightPosAddress = glGetUniformLocation(shaderProgram, "lightPos");
-        glUniform3fv(lightPosAddress, 1, glm::value_ptr(lightPos));
+        glState().bindTexture(0, GL_TEXTURE_2D, texture);
+        uniforms.set(UNIFORM_TEX0, 0);      //Send base texture 0
 
-        GLuint lightColorAddress = glGetUniformLocation(shaderProgram, "lightColor");
-        glUniform3fv(lightColorAddress, 1, glm::value_ptr(lightColor));
+        glState().bindTexture(1, GL_TEXTURE_2D, norm_tex);
+        uniforms.set(UNIFORM_NORM_TEX, 1);  //Pass texture 1 (normal map)
 
-        //Ambience
-        GLuint ambientColorAddress = glGetUniformLocation(shaderProgram, "ambientColor");
-        glUniform3fv(ambientColorAddress, 1, glm::value_ptr(ambientColor));
+        glState().bindTexture(2, GL_TEXTURE_2D, tex2);
+        uniforms.set(UNIFORM_TEX2, 2);      //Pass texture 2 (overlay)
 
-        GLuint ambientStrAddress = glGetUniformLocation(shaderProgram, "ambientStr");
-        glUniform1f(ambientStrAddress, ambientStr);
+        uniforms.set(UNIFORM_BLEND_MODE, blendMode);    //Pass blend mode
+    }
 
-        //Specular
-        GLuint specStrAddress = glGetUniformLocation(shaderProgram, "specStr");
-        glUniform1f(specStrAddress, specStr);
+    //Pick how the object is lit. The light itself comes from the LightData block
+    // @param isPointLight - Switches shader lighting mode (-1 Spotlight, 0 Unlit, 1 Point light)
+    void passLightingMode(int isPointLight) {
+        uniforms.set(UNIFORM_LIGHTING_MODE, isPointLight);
+    }
 
-        GLuint specPhongAddress = glGetUniformLocation(shaderProgram, "specPhong");
-        glUniform1f(specPhongAddress, specPhong);
+    //Vertex format and instancing switches for a mesh
+    void passMesh(const Mesh* mesh, bool instanced) {
+        uniforms.set(UNIFORM_INSTANCED, (int)instanced);
+        uniforms.set(UNIFORM_PACKED_VERTEX, (int)mesh->packed);
+        if (mesh->packed) {
+            uniforms.set(UNIFORM_BOUNDS_MIN, mesh->boundsMin);
+            uniforms.set(UNIFORM_BOUNDS_EXTENT, mesh->boundsExtent);
+        }
+    }
 
-        GLuint lighingModeAddress = glGetUniformLocation(shaderProgram, "lightingMode");
-        glUniform1i(lighingModeAddress, isPointLight);      //Pass the lighting mode
+    //Render the object with the bound program
+    // @param lod - Level of detail from selectLod, 0 is the full mesh
+    void draw(const Mesh* mesh, int lod = 0) {
+        if (mesh->VAO == 0)
+            return;     //Still loading
+        passMesh(mesh, false);
+        glState().bindVertexArray(mesh->VAO);
+        if (lod > 0 && lod < (int)mesh->lods.size())
+            glDrawElements(GL_TRIANGLES, mesh->lods[lod].indexCount, GL_UNSIGNED_INT, (void*)(sizeof(GLuint) * mesh->lods[lod].firstIndex));
+        else
+            glDrawElements(GL_TRIANGLES, mesh->indexCount, GL_UNSIGNED_INT, (void*)0);
+    }
 
-        GLuint cameraPosAddress = glGetUniformLocation(shaderProgram, "cameraPos");
-        glUniform3fv(cameraPosAddress, 1, glm::value_ptr(cameraPos));
+    //Render every instance of a mesh, one draw call per level of detail. The transform uniform is not used
+    // @param instances - Filled by InstanceBuffer::build for this mesh
+    void drawInstanced(const Mesh* mesh, const InstanceBuffer& instances) {
+        if (mesh->VAO == 0 || instances.total == 0)
+            return;
+        passMesh(mesh, true);
+        glState().bindVertexArray(mesh->VAO);
+        for (int lod = 0; lod < (int)mesh->lods.size() && lod < MESH_LOD_MAX; lod++) {
+            if (instances.lodCount[lod] == 0)
+                continue;
+            instances.attach(lod);  //No base instance before GL 4.2, so the attribute moves instead
+            glDrawElementsInstanced(GL_TRIANGLES, mesh->lods[lod].indexCount, GL_UNSIGNED_INT,
+                (void*)(sizeof(GLuint) * mesh->lods[lod].firstIndex), instances.lodCount[lod]);
+        }
+        instances.detach();
+    }
 
-        GLuint playerFacingAddress = glGetUniformLocation(shaderProgram, "playerFacing");
-        glUniform3fv(playerFacingAddress, 1, glm::value_ptr(playerFacing));
+    //Render a sprite batch, 4 strip vertices per sprite, with the sprite program bound
+    void drawSprites(const SpriteBatch& sprites) {
+        if (sprites.VAO == 0 || sprites.count == 0)
+            return;
+        glState().bindVertexArray(sprites.VAO);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, sprites.count);
     }
 
-    //Render the object
-    void draw(GLuint VAO, std::vector<GLfloat> fullVertexData) {
-        glUseProgram(shaderProgram);
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, fullVertexData.size() / 8); //Divide by number of floats inside array XYZ,normXYZ,UV
+    //Render an indexed VAO (the EBO is part of the VAO) with the float vertex layout
+    void draw(GLuint VAO, GLsizei indexCount) {
+        uniforms.set(UNIFORM_PACKED_VERTEX, 0);
+        uniforms.set(UNIFORM_INSTANCED, 0);
+        glState().bindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (void*)0);
     }
 };
 
@@ -878,6 +820,12 @@ int main(void)
     GLFWwindow* window;
     srand((unsigned) time(NULL));        //RNG seed
 
+    //Decode assets on worker threads while the window and shaders are set up
+    AssetPipeline assetPipeline;
+    assetPipeline.start();
+    meshCache.pipeline = &assetPipeline;
+    textureCache.pipeline = &assetPipeline;
+
     //INITIALIZE AND LOAD OBJ FILES
     Model bullets[MAX_PARTICLES];               //Create array of objects
     for (int i = 0; i < MAX_PARTICLES; i++) {   
@@ -966,6 +914,19 @@ int main(void)
     std::string skyboxFragS = skyboxFragBuff.str();
     const char* sky_f = skyboxFragS.c_str();
 
+    //Sprite shader
+    std::fstream spriteVertexSrc("Shaders/sprite.vert");
+    std::stringstream spriteVertexBuff;
+    spriteVertexBuff << spriteVertexSrc.rdbuf();
+    std::string spriteVertexS = spriteVertexBuff.str();
+    const char* sprite_v = spriteVertexS.c_str();
+
+    std::fstream spriteFragSrc("Shaders/sprite.frag");
+    std::stringstream spriteFragBuff;
+    spriteFragBuff << spriteFragSrc.rdbuf();
+    std::string spriteFragS = spriteFragBuff.str();
+    const char* sprite_f = spriteFragS.c_str();
+
     
 
 
@@ -986,6 +947,34 @@ int main(void)
     glfwMakeContextCurrent(window);
     gladLoadGL();
 
+    //Texture uploads go through a ring of mapped PBOs when the driver has buffer storage
+    TextureStreamer textureStreamer;
+    if (textureStreamer.create())
+        textureCache.streamer = &textureStreamer;
+    textureCache.compress = GLAD_GL_EXT_texture_compression_s3tc != 0;   //BC1/BC3, BC5 is core
+
+    //Camera and light blocks, written once a frame and read by every program
+    UniformBuffer frameUniforms, lightUniforms;
+    frameUniforms.create(UNIFORM_BLOCK_FRAME, sizeof(FrameBlock));
+    lightUniforms.create(UNIFORM_BLOCK_LIGHT, sizeof(LightBlock));
+
+    //Per frame vertex data: bullet and fluid instances, soft body positions
+    FrameRingBuffer frameRing;
+    frameRing.create();
+    InstanceBuffer bulletInstances, fluidInstances;
+
+    //Draws for each frame, sorted to group state
+    RenderQueue renderQueue;
+
+    //Nearest planets rasterized on the CPU to skip the ones hidden behind them
+    OcclusionBuffer occlusion;
+    occlusion.resize(OCCLUSION_WIDTH, OCCLUSION_HEIGHT);
+    std::vector<glm::vec4> occluderCandidates;   //xyz position, w scale
+
+    //Bullets and fluid too small on screen for the planet mesh
+    SpriteBatch particleSprites;
+    particleSprites.create();
+
 
     //LOAD THE TEXTURES
     for (int i = 0; i < MAX_PARTICLES; i++) {
@@ -999,19 +988,24 @@ int main(void)
     playerShip.loadTexture("3D/camo_pattern.png", 2);
     */
 
-    glEnable(GL_DEPTH_TEST); //For rendering front of obj only
+    glState().enable(GL_DEPTH_TEST); //For rendering front of obj only
 
     //CREATE THE SHADER PROGRAMS
     Shader objectShader;
     objectShader.generateShaderProgram(vertSrc, fragSrc);   //Object/model shader using sample.frag & sample.vert
-    GLuint shaderProgram = objectShader.shaderProgram;
     
     Shader skybox;
     skybox.generateShaderProgram(sky_v, sky_f);             //Skybox shader using skybox.frag & skybox.vert
-    GLuint skyboxShader = skybox.shaderProgram;
+
+    Shader spriteShader;
+    spriteShader.generateShaderProgram(sprite_v, sprite_f); //Far particles as billboards using sprite.frag & sprite.vert
+
+    //Programs the render queue switches between, indexed by the shader part of a sort key
+    enum { SHADER_OBJECT, SHADER_SPRITE };
+    Shader* queueShaders[] = { &objectShader, &spriteShader };
 
     
-    //GENERATE THE VAOs and VBOs
+    //GENERATE THE VAOs and VBOs (the asset pipeline already uploaded them)
     for (int i = 0; i < MAX_PARTICLES; i++) {
         bullets[i].generateVAO();
     }
@@ -1023,7 +1017,7 @@ int main(void)
     glGenBuffers(1, &skyboxVBO);
     glGenBuffers(1, &skyboxEBO);
 
-    glBindVertexArray(skyboxVAO);
+    glState().bindVertexArray(skyboxVAO);
     glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float), (void*)0);
@@ -1033,14 +1027,14 @@ int main(void)
     glEnableVertexAttribArray(0);
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    glState().bindVertexArray(0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
 
     //Skybox Texture
     unsigned int skyboxTex;
     glGenTextures(1, &skyboxTex);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTex);
+    glState().bindTexture(GL_TEXTURE_CUBE_MAP, skyboxTex);
     //Avoid pixelate. Blurs according to size
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);  //Max size
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);  //Min size
@@ -1050,30 +1044,38 @@ int main(void)
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
    
     for (unsigned int i = 0; i < 6; i++) {
-        int w, h, skyChannel;
-        stbi_set_flip_vertically_on_load(false);
-        unsigned char* data = stbi_load(facesSkybox[i].c_str(), &w, &h, &skyChannel, 0);
-
-        if (data) {
-            glTexImage2D(
-                GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, //R, L, T, B, F, Bk
-                0,
-                GL_RGBA,    //Swtiched to RGBA since skybox altered to PNG with alpha when saving
-                w,
-                h,
-                0,
-                GL_RGBA,
-                GL_UNSIGNED_BYTE,
-                data
-                );
-
-            stbi_image_free(data);
-        }
-        else {
-
-        }
+        std::shared_ptr<TextureData> face(new TextureData());
+        std::string facePath = facesSkybox[i];
+        bool compressed = textureCache.compress;
+        assetPipeline.submit([facePath, face, compressed] { loadTextureData(facePath, false, false, compressed, *face); },  //Cube maps are not flipped
+            [face, i, skyboxTex, &textureStreamer] {
+                glState().bindTexture(GL_TEXTURE_CUBE_MAP, skyboxTex);
+                if (face->compressed.blocks) {
+                    uploadCompressedImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, face->compressed, &textureStreamer);
+                    return;
+                }
+                if (!face->image.pixels)
+                    return;
+                const void* source = face->image.pixels;
+                bool streamed = textureStreamer.stage(face->image.pixels, (size_t)face->image.width * face->image.height * 4, source);
+                glTexImage2D(
+                    GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, //R, L, T, B, F, Bk
+                    0,
+                    GL_RGBA,    //Swtiched to RGBA since skybox altered to PNG with alpha when saving
+                    face->image.width,
+                    face->image.height,
+                    0,
+                    GL_RGBA,
+                    GL_UNSIGNED_BYTE,
+                    source
+                    );
+                if (streamed)
+                    textureStreamer.commit();
+            });
     }
-    //stbi_set_flip_vertically_on_load(true);
+
+    //Wait for the meshes, textures and skybox faces, uploading each as it finishes
+    assetPipeline.finish();
 
 
     //Create a pointlight and spotlight light instance
@@ -1094,6 +1096,7 @@ int main(void)
 
     //Set staring camera as the perspective one
     glm::vec3 cameraPos = mainCam.cameraPos;
+    glm::vec3 cameraFront = glm::vec3(0.f, 0.f, -1.f);     //Aim direction for the laser
     glm::mat4 view = mainCam.view;
     glm::mat4 projection = mainCam.projection;
 
@@ -1134,6 +1137,38 @@ int main(void)
     AnchoredSpring anchorS1(ORIGIN);    //Anchored spring calculator. Anchored to origin
     BasicSpring basicS1;
     ElasticBungee elasticS1;
+
+    SpatialQuery particleQuery;         //Hit tests against the live particles
+    glm::vec3 livePos[MAX_SPRINGS];
+    float liveRadius[MAX_SPRINGS];
+    int liveFlags[MAX_SPRINGS];
+
+    BroadPhase broadphase;              //Tracks overlapping pairs of particles for contacts
+    float particleRadius[MAX_SPRINGS];  //Collision radius of each particle, from its mesh and render scale
+    int particleProxy[MAX_SPRINGS];     //Broadphase proxy of each particle
+    glm::vec3 lastPartPos[MAX_SPRINGS]; //Position at the last broadphase update
+    for (int i = 0; i < MAX_SPRINGS; i++)
+        particleProxy[i] = NULL_NODE;
+
+    int springEnds[2] = { 0, 1 };       //Particle index of each spring end. Remapped when storage is reordered
+    std::vector<int> reorderPerm;       //Old index for every new particle slot
+    int stepsSinceReorder = 0;
+
+    std::vector<Particle> fluidParticles(FLUID_PARTICLES);     //Fluid block
+    std::vector<glm::vec3> fluidPos(FLUID_PARTICLES);
+    int fluidSlots = 0;                 //Despawn counter for the fluid block
+    SPHForce sphForce;                  //Liquid forces calculator
+
+    SoftBody softBody;                  //Planet mesh as a mass-spring lattice
+    int softSlots = 0;
+    const Mesh* softBodySource = bullets[0].mesh;
+    buildLattice(meshVertices(*softBodySource), softBodySource->vertexCount, lodIndexData(*softBodySource, 0), (size_t)softBodySource->indexCount, SOFTBODY_SCALE, softBodyCenter, SOFTBODY_STIFFNESS, true, true, softBody.lattice);
+    SkinnedMesh softBodyMesh;
+    softBodyMesh.generate(meshVertices(*softBodySource), softBodySource->vertexCount, lodIndexData(*softBodySource, 0), softBodySource->indexCount, softBody.lattice.vertexToPoint);
+    sphForce.solver.smoothingRadius = 2.f * FLUID_SPACING;
+    sphForce.solver.restDensity = massSettings[FLUID - 1] / (FLUID_SPACING * FLUID_SPACING * FLUID_SPACING);
+    sphForce.solver.boundsMin = fluidBoundsMin;
+    sphForce.solver.boundsMax = fluidBoundsMax;
     //PARTICLE_HW(2/3) END
 
     // Old fireworks HW
@@ -1144,6 +1179,7 @@ int main(void)
     
     while (!glfwWindowShouldClose(window))  //Main loop for each frame
     {
+        assetPipeline.processUploads();     //Assets requested mid-session
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         //Frame and time calculator
@@ -1159,12 +1195,14 @@ int main(void)
         if (isPerspMode > 0) {
             mainCam.updateCamera(window, frameTime, glm::vec3(0.f,0.f,-30.f) /*glm::vec3(playerShip.position[0], playerShip.position[1], playerShip.position[2])*/, 0, 0);    //Camera's position. switch with player position
             cameraPos = mainCam.cameraPos;
+            cameraFront = mainCam.centerPos - mainCam.cameraPos;
             view = mainCam.view;
             projection = mainCam.projection;
         }
         else {
             topCam.updateCamera(window, frameTime, glm::vec3(0.f, 0.f, 0.f), movementInput[0], movementInput[1]);
             cameraPos = topCam.cameraPos;
+            cameraFront = topCam.centerPos - topCam.cameraPos;
             view = topCam.view;
             projection = topCam.projection;
         }
@@ -1204,59 +1242,170 @@ int main(void)
             frameTime -= deltaTime;                         //Deduct with deltaTime for next loop
 
             //PARTICLE HW(3/x)
+            //REORDER
+            //Keep particles that are close in space close in memory for the neighbour passes
+            if (++stepsSinceReorder >= REORDER_INTERVAL) {
+                stepsSinceReorder = 0;
+                for (int i = 0; i < MAX_SPRINGS; i++)
+                    livePos[i] = bulletParticle[i].partPos;
+                mortonOrder(livePos, MAX_SPRINGS, reorderPerm);
+
+                applyPermutation(bulletParticle, reorderPerm);  //Everything stored per particle moves along
+                applyPermutation(particleProxy, reorderPerm);
+                applyPermutation(lastPartPos, reorderPerm);
+                remapIndices(springEnds, 2, reorderPerm);
+                for (int i = 0; i < MAX_SPRINGS; i++)
+                    if (particleProxy[i] != NULL_NODE)
+                        broadphase.tree.setUserData(particleProxy[i], i);
+
+                for (int i = 0; i < FLUID_PARTICLES; i++)   //SPH neighbour pass
+                    fluidPos[i] = fluidParticles[i].partPos;
+                mortonOrder(fluidPos.data(), FLUID_PARTICLES, reorderPerm);
+                applyPermutation(fluidParticles.data(), reorderPerm);
+
+                softBody.reorder(reorderPerm, softBodyMesh);    //Lattice springs, the largest spring network
+            }
+            Particle& springA = bulletParticle[springEnds[0]];  //Anchor/first end
+            Particle& springB = bulletParticle[springEnds[1]];  //End the user pushes
+
             //INITIALIZATION
             
             if (isSwitched) {
                 for (int i = 0; i < MAX_SPRINGS; i++) {
                     bulletParticle[i].despawnParticle(&particleSlots);
                 }
+                for (int i = 0; i < FLUID_PARTICLES; i++) {
+                    fluidParticles[i].despawnParticle(&fluidSlots);
+                }
+                softBody.despawn(&softSlots);
 
-                bulletParticle[0].initParticle(projectileType, bullets[0].scale, currTime, springsInitPos[projectileType - 1][0]);
-                bulletParticle[1].initParticle(projectileType, bullets[0].scale, currTime, springsInitPos[projectileType - 1][1]);
-                bulletParticle[0].partVel = glm::vec3(0.f, 0.f, 0.f);   //Stop one pair from moving to show it reacts to the other spring end
+                if (projectileType == FLUID) {
+                    //Stack the block in a corner of the container so it collapses and sloshes
+                    for (int i = 0; i < FLUID_PARTICLES; i++) {
+                        glm::vec3 cell = glm::vec3(i % FLUID_SIDE, (i / FLUID_SIDE) % FLUID_SIDE, i / (FLUID_SIDE * FLUID_SIDE));
+                        fluidParticles[i].initParticle(FLUID, 1.f, currTime, fluidBoundsMin + glm::vec3(FLUID_SPACING) + cell * FLUID_SPACING);
+                    }
+                }
+                else if (projectileType == SOFT_BODY) {
+                    softBody.spawn(currTime);
+                }
+                else {
+                    springA.initParticle(projectileType, bullets[0].scale, currTime, springsInitPos[projectileType - 1][0]);
+                    springB.initParticle(projectileType, bullets[0].scale, currTime, springsInitPos[projectileType - 1][1]);
+                    springA.partVel = glm::vec3(0.f, 0.f, 0.f);   //Stop one pair from moving to show it reacts to the other spring end
 
-                if (projectileType == ANCHORED_SPRING)
-                    bulletParticle[0].mass = 0;     //Turn the anchor into a stationary object to exit updateMotion()
+                    if (projectileType == ANCHORED_SPRING)
+                        springA.mass = 0;     //Turn the anchor into a stationary object to exit updateMotion()
+                }
                 isSwitched = INACTIVE;
             }
 
             //Let user apply force
             if (isFired) {
-                registryGeneral.add(&(bulletParticle[1]), &constantGeneral);    //Only apply force to one of the particle pairs
+                if (projectileType == LASER) {  //Hitscan instead of pushing
+                    for (int i = 0; i < MAX_SPRINGS; i++) {
+                        livePos[i] = bulletParticle[i].partPos;
+                        liveRadius[i] = bullets[i].mesh->radius * SPRING_RENDER_SCALE;
+                        liveFlags[i] = bulletParticle[i].partType;
+                    }
+                    particleQuery.build(livePos, liveRadius, liveFlags, MAX_SPRINGS);
+
+                    RayHit laserHit;
+                    if (particleQuery.raycast(cameraPos, cameraFront, LASER_RANGE, &laserHit))
+                        bulletParticle[laserHit.index].despawnParticle(&particleSlots);     //Destroy the particle hit
+                }
+                else if (projectileType == SOFT_BODY) {
+                    if (softBody.isActive())
+                        registryGeneral.add(&softBody.parts[softBody.pokePoint], &constantGeneral);  //Poke one vertex
+                }
+                else if (springB.partType)
+                    registryGeneral.add(&springB, &constantGeneral);    //Only apply force to one of the particle pairs
                 isFired = INACTIVE;
             }
 
+            //Gravity and drag on the pushed end, only while a spring mode has it alive.
+            //A despawned particle never clears its forces, so they would pile up until it respawns
+            auto addSpringEndForces = [&]() {
+                if (springB.partType) {
+                    registryGeneral.add(&springB, &gravityGeneral);     //Gravity toggle in particle.h
+                    registryGeneral.add(&springB, &dragGeneral);        //Drag toggled on for all springs
+                }
+            };
+
             //Force updates
             switch (projectileType) {
             case BASIC_SPRING:
-                basicS1.linkOtherEnd(bulletParticle[0].partPos);               //Link the other end
-                registryGeneral.add(&(bulletParticle[1]), &basicS1);           //Calculate spring force
-                basicS1.linkOtherEnd(bulletParticle[1].partPos);               //Repeat for other end
-                registryGeneral.add(&(bulletParticle[0]), &basicS1);
+                basicS1.linkOtherEnd(springA.partPos);               //Link the other end
+                registryGeneral.add(&springB, &basicS1);           //Calculate spring force
+                basicS1.linkOtherEnd(springB.partPos);               //Repeat for other end
+                registryGeneral.add(&springA, &basicS1);
+                addSpringEndForces();
                 break;
             case ELASTIC_BUNGEE:
-                elasticS1.linkOtherEnd(bulletParticle[0].partPos);
-                registryGeneral.add(&(bulletParticle[1]), &elasticS1);
-                elasticS1.linkOtherEnd(bulletParticle[1].partPos);
-                registryGeneral.add(&(bulletParticle[0]), &elasticS1);
+                elasticS1.linkOtherEnd(springA.partPos);
+                registryGeneral.add(&springB, &elasticS1);
+                elasticS1.linkOtherEnd(springB.partPos);
+                registryGeneral.add(&springA, &elasticS1);
+                addSpringEndForces();
                 break;
             case ANCHORED_SPRING:
-                registryGeneral.add(&(bulletParticle[1]), &anchorS1);
+                registryGeneral.add(&springB, &anchorS1);
+                addSpringEndForces();
+                break;
+            case LASER:     //Targets float freely
+                break;
+            case FLUID:
+                sphForce.computeForces(fluidParticles.data(), FLUID_PARTICLES);
+                for (int i = 0; i < FLUID_PARTICLES; i++) {
+                    registryGeneral.add(&fluidParticles[i], &sphForce);
+                    registryGeneral.add(&fluidParticles[i], &gravityGeneral);
+                }
+                break;
+            case SOFT_BODY:
+                if (softBody.isActive()) {
+                    softBody.applySprings(&registryGeneral);
+                    for (size_t i = 0; i < softBody.parts.size(); i++)
+                        registryGeneral.add(&softBody.parts[i], &dragGeneral);
+                }
                 break;
             default:
                 std::cout << "NO SPRING SELECTED" << std::endl;
             }
-            //Add gravity and drag if activated
-            registryGeneral.add(&(bulletParticle[1]), &gravityGeneral);     //Gravity toggle in particle.h
-            registryGeneral.add(&(bulletParticle[1]), &dragGeneral);        //Drag toggled on for all springs
 
             //Motion updates using all active forces
-            bulletParticle[0].updateMotion(deltaTime, currTime, &particleSlots);
-            bulletParticle[1].updateMotion(deltaTime, currTime, &particleSlots);
+            for (int i = 0; i < MAX_SPRINGS; i++)
+                bulletParticle[i].updateMotion(deltaTime, currTime, &particleSlots);
+            for (int i = 0; i < FLUID_PARTICLES; i++)
+                fluidParticles[i].updateMotion(deltaTime, currTime, &fluidSlots);
+            for (size_t i = 0; i < softBody.parts.size(); i++)
+                softBody.parts[i].updateMotion(deltaTime, currTime, &softSlots);
+
+            //Sync the broadphase. Proxies still inside their fat bounds aren't touched or re-queried
+            for (int i = 0; i < MAX_SPRINGS; i++) {
+                particleRadius[i] = bullets[i].mesh->radius * SPRING_RENDER_SCALE;
+                AABB partBounds = AABB::fromSphere(bulletParticle[i].partPos, particleRadius[i]);
+                if (bulletParticle[i].partType && particleProxy[i] == NULL_NODE)
+                    particleProxy[i] = broadphase.createProxy(partBounds, i);
+                else if (!bulletParticle[i].partType && particleProxy[i] != NULL_NODE) {
+                    broadphase.destroyProxy(particleProxy[i]);
+                    particleProxy[i] = NULL_NODE;
+                }
+                else if (particleProxy[i] != NULL_NODE)
+                    broadphase.moveProxy(particleProxy[i], partBounds, bulletParticle[i].partPos - lastPartPos[i]);
+                lastPartPos[i] = bulletParticle[i].partPos;
+            }
+            broadphase.updatePairs();
+
+            //Collide the pairs whose fat bounds overlap. The spheres themselves may still be apart
+            for (size_t p = 0; p < broadphase.pairs.size(); p++) {
+                int i = broadphase.tree.getUserData(broadphase.pairs[p].first);
+                int j = broadphase.tree.getUserData(broadphase.pairs[p].second);
+                resolveContact(bulletParticle[i], bulletParticle[j], particleRadius[i], particleRadius[j]);
+            }
 
             //Copy particle pos to model pos
-            bullets[0].translate(bulletParticle[0].partPos);
-            bullets[1].translate(bulletParticle[1].partPos);
+            for (int i = 0; i < MAX_SPRINGS; i++)
+                bullets[i].translate(bulletParticle[i].partPos);
 
 
             //PARTICLE_HW(3/3) END
@@ -1349,59 +1498,101 @@ int main(void)
 
 
 
-        //SKYBOX SHADER
-        glDepthMask(GL_FALSE);
-        glDepthFunc(GL_LEQUAL);
+        frameRing.beginFrame();     //Waits only if the GPU is still on the frame from three frames ago
 
-        glUseProgram(skyboxShader);
+        //Per frame camera and light state for every shader
+        FrameBlock frameBlock = { view, projection, cameraPos, 0.f };
+        frameUniforms.update(&frameBlock, sizeof(frameBlock));
+        LightBlock lightBlock = { lightPos, ambientStr, lightColor, specStr, ambientColor, specPhong, playerFacing, 0.f };
+        lightUniforms.update(&lightBlock, sizeof(lightBlock));
 
-        glm::mat4 sky_view = glm::mat4(1.f);
-        sky_view = glm::mat4(glm::mat3(view));  
 
-        //Pass the view and projection matrix to the skybox shader
-        unsigned int skyboxViewLoc = glGetUniformLocation(skyboxShader, "view");
-        glUniformMatrix4fv(skyboxViewLoc, 1, GL_FALSE, glm::value_ptr(sky_view));
+        //SKYBOX SHADER
+        glState().depthMask(GL_FALSE);
+        glState().depthFunc(GL_LEQUAL);
 
-        unsigned int skyboxProjLoc = glGetUniformLocation(skyboxShader, "projection");
-        glUniformMatrix4fv(skyboxProjLoc, 1, GL_FALSE, glm::value_ptr(projection));
+        skybox.use();   //View and projection come from FrameData, the shader drops the translation
 
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTex);
+        glState().bindVertexArray(skyboxVAO);
+        glState().bindTexture(0, GL_TEXTURE_CUBE_MAP, skyboxTex);
 
         glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-        glDepthMask(GL_TRUE);
-        glDepthFunc(GL_LESS);
+        glState().depthMask(GL_TRUE);
+        glState().depthFunc(GL_LESS);
 
 
 
 
         //OBJECT SHADERS
-        glUseProgram(shaderProgram);    //Reset to shader program, otherwise obj won't draw
-        /*
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        */
-
-        //Render the active bullets
-        for (int i = 0; i < MAX_PARTICLES; i++) {
-            if (bulletParticle[i].partType) {   //Render when a particle is still active
-                    objectShader.passMVP(bullets[i].transform, projection, view);
-                    objectShader.passTextures(bullets[i].texBase, bullets[i].texNorm, bullets[i].texOverlay, 1);    //0-Base tex and normal only , 1-Base tex with overlay , 2-Base tex with multiply
-                    objectShader.passLight(lightPos, lightColor, ambientColor, ambientStr, specStr, specPhong, cameraPos, 0, playerFacing);
-                    objectShader.draw(bullets[i].VAO, bullets[i].fullVertexData);
-                }
-            }
-        
+        Frustum frustum = extractFrustum(projection * view);    //Whichever camera is active
+
+        //Occlusion: the planets nearest the camera are rasterized with their coarsest LOD
+        occlusion.clear(projection * view);
+        occluderCandidates.clear();
+        for (int i = 0; i < MAX_SPRINGS; i++)
+            if (bulletParticle[i].partType)
+                occluderCandidates.push_back(glm::vec4(bulletParticle[i].partPos, 1.f));
+        for (int i = 0; i < FLUID_PARTICLES; i++)
+            if (fluidParticles[i].partType)
+                occluderCandidates.push_back(glm::vec4(fluidParticles[i].partPos, FLUID_RENDER_SCALE));
+        auto nearer = [&view](const glm::vec4& a, const glm::vec4& b) {
+            return (view * glm::vec4(glm::vec3(a), 1.f)).z > (view * glm::vec4(glm::vec3(b), 1.f)).z;   //View space looks down -z
+        };
+        size_t occluderCount = std::min(occluderCandidates.size(), (size_t)OCCLUSION_MAX_OCCLUDERS);
+        std::partial_sort(occluderCandidates.begin(), occluderCandidates.begin() + occluderCount, occluderCandidates.end(), nearer);
+        const Mesh* planetMesh = bullets[0].mesh;
+        int coarsest = (int)planetMesh->lods.size() - 1;
+        for (size_t i = 0; i < occluderCount && coarsest >= 0; i++) {
+            glm::mat4 occluderTransform = glm::scale(glm::translate(glm::mat4(1.f), glm::vec3(occluderCandidates[i])), glm::vec3(occluderCandidates[i].w));
+            occlusion.addOccluder(meshVertices(*planetMesh), MESH_STRIDE, lodIndexData(*planetMesh, coarsest),
+                (int)planetMesh->lods[coarsest].indexCount, occluderTransform);     //Behind the camera is dropped per triangle
+        }
+        occlusion.rasterize();
+        Material planetMaterial = { bullets[0].texBase, bullets[0].texNorm, bullets[0].texOverlay, 1, 0 };     //Blend mode: 0-Base tex and normal only , 1-Base tex with overlay , 2-Base tex with multiply
+        Material fluidMaterial = planetMaterial;
+        fluidMaterial.blendMode = 0;
+
+        //Queue the active bullets, all sharing one mesh and material, as one instanced draw per LOD.
+        //Bullets and fluid under SPRITE_SWITCH_PIXELS on screen become sprites instead
+        particleSprites.clear();
+        bulletInstances.build(frameRing, *bullets[0].mesh, MAX_SPRINGS, [&](int i, glm::vec3& position, float& scale) {
+            position = bulletParticle[i].partPos;
+            scale = SPRING_RENDER_SCALE;
+            return bulletParticle[i].partType != 0;    //Render when a particle is still active
+        }, frustum, &occlusion, view, projection, screenHeight, &particleSprites);
+        renderQueue.submitInstanced(RENDER_PASS_OPAQUE, SHADER_OBJECT, renderQueue.materialId(planetMaterial), bullets[0].mesh, &bulletInstances);
+
+        //Queue the fluid with a shrunk planet mesh
+        fluidInstances.build(frameRing, *bullets[0].mesh, FLUID_PARTICLES, [&](int i, glm::vec3& position, float& scale) {
+            position = fluidParticles[i].partPos;
+            scale = FLUID_RENDER_SCALE;
+            return fluidParticles[i].partType != 0;
+        }, frustum, &occlusion, view, projection, screenHeight, &particleSprites);
+        renderQueue.submitInstanced(RENDER_PASS_OPAQUE, SHADER_OBJECT, renderQueue.materialId(fluidMaterial), bullets[0].mesh, &fluidInstances);
+
+        //Queue the far particles as one sprite draw. Opaque unless a tint has alpha
+        particleSprites.upload(frameRing, view);
+        if (particleSprites.count > 0)
+            renderQueue.submitSprites(particleSprites.blended ? RENDER_PASS_BLENDED : RENDER_PASS_OPAQUE, SHADER_SPRITE,
+                renderQueue.materialId(fluidMaterial), &particleSprites);   //Base texture only
+
+        //Queue the soft body skinned straight from its particles
+        if (softBody.isActive()) {
+            softBodyMesh.upload(frameRing, softBody.gatherPositions());
+            renderQueue.submitVAO(RENDER_PASS_OPAQUE, SHADER_OBJECT, renderQueue.materialId(planetMaterial), 0.f,
+                softBodyMesh.VAO, softBodyMesh.indexCount, glm::mat4(1.f));    //Particles are already in world space
+        }
 
         /*
-        //Render the player model
-        objectShader.passMVP(playerShip.transform, projection, view);
-        objectShader.passTextures(playerShip.texBase, playerShip.texNorm, playerShip.texOverlay, 2);
-        objectShader.passLight(lightPos, lightColor, ambientColor, ambientStr, specStr, specPhong, cameraPos, isPointLight, playerFacing);
-        objectShader.draw(playerShip.VAO, playerShip.fullVertexData);
+        //Queue the player model
+        Material shipMaterial = { playerShip.texBase, playerShip.texNorm, playerShip.texOverlay, 2, isPointLight };
+        renderQueue.submitMesh(RENDER_PASS_OPAQUE, SHADER_OBJECT, renderQueue.materialId(shipMaterial),
+            viewDepth(view, glm::vec3(playerShip.transform[3])), playerShip.mesh, playerShip.transform);
         */
-        glDisable(GL_BLEND);    //Stop blending to avoid affecting other textures
+
+        renderQueue.execute(queueShaders);   //Sorted by pass, shader, material then depth
+        glState().disable(GL_BLEND);    //Stop blending to avoid affecting other textures
+        frameRing.endFrame();
 
 
         glfwSwapBuffers(window);
@@ -1410,15 +1601,23 @@ int main(void)
         //end of while loop
         }
 
-    //Clean up the VAO and VBO
+    //Clean up the VAO, VBO and textures (freed with the last reference)
     for (int i = 0; i < MAX_PARTICLES; i++) {
-        glDeleteVertexArrays(1, &bullets[i].VAO);
-        glDeleteBuffers(1, &bullets[i].VBO);
+        bullets[i].release();
     }
+    softBodyMesh.destroy();
     /*
-    glDeleteVertexArrays(1, &playerShip.VAO);
-    glDeleteBuffers(1, &playerShip.VBO);
+    playerShip.release();
     */
+    meshCache.pipeline = NULL;
+    textureCache.pipeline = NULL;
+    textureCache.streamer = NULL;
+    assetPipeline.stop();
+    textureStreamer.destroy();
+    frameUniforms.destroy();
+    lightUniforms.destroy();
+    particleSprites.destroy();
+    frameRing.destroy();
     glfwTerminate();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,116 @@
+#ifndef MAPPED_FILE_FILE
+#define MAPPED_FILE_FILE
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX        //Keeps std::min and std::max usable
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//Read only view of a whole file mapped into memory. Pages are loaded by the OS on first touch
+class MappedFile {
+public:
+    const unsigned char* data = NULL;
+    size_t size = 0;
+
+    MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    //Maps the file. Empty or missing files fail
+    // @param path - File to map
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!mapping) {
+            close();
+            return false;
+        }
+        data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        size = (size_t)fileSize.QuadPart;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void* view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);    //The mapping keeps its own reference
+        if (view == MAP_FAILED)
+            return false;
+        madvise(view, (size_t)info.st_size, MADV_SEQUENTIAL);
+        data = (const unsigned char*)view;
+        size = (size_t)info.st_size;
+#endif
+        if (!data) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    bool isOpen() const { return data != NULL; }
+
+    void close() {
+#ifdef _WIN32
+        if (data)
+            UnmapViewOfFile(data);
+        if (mapping)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data)
+            munmap((void*)data, size);
+#endif
+        data = NULL;
+        size = 0;
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#endif
+};
+
+//Size and modified time of a source file
+inline bool sourceStamp(const std::string& path, uint64_t& size, int64_t& time) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        return false;
+    size = (uint64_t)info.st_size;
+    time = (int64_t)info.st_mtime;
+    return true;
+}
+
+#endif
@@ -0,0 +1,498 @@
+#ifndef MESH_CACHE_FILE
+#define MESH_CACHE_FILE
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <iostream>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <cfloat>
+#include <algorithm>
+#include "mappedfile.h"
+#include "meshoptimize.h"
+#include "meshsimplify.h"
+#include "vertexpack.h"
+#include "assetpipeline.h"
+#include "objparser.h"
+#include "tangents.h"
+#include "glstate.h"
+#ifndef TINYOBJLOADER_IMPLEMENTATION   //main.cpp already pulled in the loader with its implementation
+#include "tiny_obj_loader.h"
+#endif
+
+#ifndef MESH_STRIDE
+#define MESH_STRIDE 14      //Floats per vertex: XYZ, normal XYZ, UV, tan XYZ, bitan XYZ
+#endif
+
+#define COOKED_MESH_MAGIC 0x4853454d    //"MESH"
+#define COOKED_MESH_VERSION 5           //Bump whenever the layout or the vertex data changes
+#define COOKED_MESH_EXTENSION ".mesh"   //Written next to the OBJ
+#define MESH_LOD_PIXEL_ERROR 1.f        //Use the coarsest level whose error stays under this many pixels on screen
+
+//Start of a cooked mesh file. The interleaved vertex data follows right after, then the same vertices as PackedVertex,
+//then the indices of every level, then the LOD table
+struct CookedMeshHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t stride;        //Floats per vertex
+    uint32_t vertexCount;
+    uint32_t indexCount;    //All levels together
+    uint32_t lodCount;
+    uint64_t sourceSize;    //Size and modified time of the OBJ it was cooked from
+    int64_t sourceTime;
+    float center[3];        //Bounding sphere, so loading skips the pass over the vertices
+    float radius;
+    float boundsMin[3];     //Position box, what PackedVertex positions dequantize with
+    float boundsExtent[3];
+};
+
+//One loaded OBJ. The CPU copy and GPU buffers are shared by every Model using the same file
+struct Mesh {
+    std::string path;
+    std::vector<GLfloat> fullVertexData;    //Full vertex data array. Empty for cooked meshes, read them through meshVertices
+    std::vector<PackedVertex> packedVertexData;     //Same vertices quantized while loading. Freed after upload, empty for cooked meshes
+    std::vector<GLuint> indices;            //3 per triangle, in vertex cache order. Empty for cooked meshes
+    std::vector<GLuint> lodIndices;         //Coarser levels, stored after indices in the EBO. Empty for cooked meshes
+    std::vector<MeshLod> lods;              //Level 0 is the full mesh
+    GLuint VAO = 0, VBO = 0, EBO = 0;       //VAO, VBO & EBO, 0 until uploaded
+    GLsizei vertexCount = 0, indexCount = 0;    //indexCount is level 0 only
+    glm::vec3 center = glm::vec3(0.f);      //Bounding sphere for LOD selection
+    float radius = 0.f;
+    int refCount = 0;
+    bool loading = false;                   //Still parsing on the asset pipeline
+
+    bool packed = false;                    //GPU copy uses PackedVertex. Positions dequantize with the bounds
+    glm::vec3 boundsMin = glm::vec3(0.f), boundsExtent = glm::vec3(1.f);
+
+    MappedFile cooked;                      //Cooked file, mapped for as long as the mesh lives
+    const GLfloat* cookedVertices = NULL;
+    const PackedVertex* cookedPackedVertices = NULL;
+    const GLuint* cookedIndices = NULL;     //Every level
+    GLsizei cookedIndexCount = 0;
+};
+
+//Parses an OBJ into a welded, indexed vertex array
+// @param path - String of the 3D obj's location
+// @param out - Receives XYZ + normals XYZ + UV + tan XYZ + Btan XYZ for every unique vertex
+// @param indices - Receives 3 vertex indices per triangle
+inline bool parseObj(const std::string& path, std::vector<GLfloat>& out, std::vector<unsigned int>& indices) {
+    std::vector<tinyobj::shape_t> shapes;
+    std::string error;
+
+    tinyobj::attrib_t attributes;
+
+    bool success = loadObjParallel(path, attributes, shapes, error);    //Chunked across cores, same output as tinyobj::LoadObj
+    if (!success || shapes.empty()) {
+        std::cout << "Failed to load " << path << ": " << error << std::endl;
+        return false;
+    }
+
+    //VERTEX DATA ARRAY
+    //Important data for position XYZ + normals XYZ + UV + tan XYZ + Btan XYZ
+    //Corners sharing the same position, normal and UV are welded into one vertex
+    struct CornerHash {
+        size_t operator()(const tinyobj::index_t& c) const {
+            return (size_t)((uint32_t)c.vertex_index * 73856093u ^ (uint32_t)c.normal_index * 19349663u ^ (uint32_t)c.texcoord_index * 83492791u);
+        }
+    };
+    struct CornerEqual {
+        bool operator()(const tinyobj::index_t& a, const tinyobj::index_t& b) const {
+            return a.vertex_index == b.vertex_index && a.normal_index == b.normal_index && a.texcoord_index == b.texcoord_index;
+        }
+    };
+    std::unordered_map<tinyobj::index_t, unsigned int, CornerHash, CornerEqual> welded;
+    indices.reserve(shapes[0].mesh.indices.size());
+    for (int i = 0; i < shapes[0].mesh.indices.size(); i++) {
+        tinyobj::index_t vData = shapes[0].mesh.indices[i];
+
+        std::unordered_map<tinyobj::index_t, unsigned int, CornerHash, CornerEqual>::iterator found = welded.find(vData);
+        if (found != welded.end()) {
+            indices.push_back(found->second);
+            continue;
+        }
+        unsigned int index = (unsigned int)(out.size() / MESH_STRIDE);
+        welded.insert(std::make_pair(vData, index));
+        indices.push_back(index);
+
+        int pos_offset = (vData.vertex_index) * 3;
+        int norm_offset = (vData.normal_index) * 3;
+        int tex_offset = (vData.texcoord_index) * 2;
+        //X Index 0
+        out.push_back(
+            attributes.vertices[pos_offset]);
+        //Y Index 1
+        out.push_back(
+            attributes.vertices[pos_offset + 1]);
+        //Z Index 2
+        out.push_back(
+            attributes.vertices[pos_offset + 2]);
+
+        //normals X Index 3
+        out.push_back(
+            attributes.normals[norm_offset]);
+        //normals Y Index 4
+        out.push_back(
+            attributes.normals[norm_offset + 1]);
+        //normals Z Index 5
+        out.push_back(
+            attributes.normals[norm_offset + 2]);
+
+        //U Index 6
+        out.push_back(
+            attributes.texcoords[tex_offset]);
+        //V Index 7
+        out.push_back(
+            attributes.texcoords[tex_offset + 1]);
+
+        //Tangents      Index 8,9,10 and Bitangents    Index 11,12,13, filled below
+        out.insert(out.end(), 6, 0.f);
+    }
+
+    //Tangents and bitangents for lighting, averaged over the triangles sharing each vertex
+    generateTangents(out.data(), (int)(out.size() / MESH_STRIDE), indices.data(), (int)indices.size(), true);
+    return true;
+}
+
+//Writes a parsed mesh's final vertex and index data, level table and bounds to <path>.mesh so later runs can skip the parse
+// @param mesh - Parsed mesh with its bounds and LOD chain built
+inline bool writeCookedMesh(const Mesh& mesh) {
+    CookedMeshHeader header = {};
+    header.magic = COOKED_MESH_MAGIC;
+    header.version = COOKED_MESH_VERSION;
+    header.stride = MESH_STRIDE;
+    header.vertexCount = (uint32_t)mesh.vertexCount;
+    header.indexCount = (uint32_t)(mesh.indices.size() + mesh.lodIndices.size());
+    header.lodCount = (uint32_t)mesh.lods.size();
+    if (!sourceStamp(mesh.path, header.sourceSize, header.sourceTime))
+        return false;
+    for (int k = 0; k < 3; k++) {
+        header.center[k] = mesh.center[k];
+        header.boundsMin[k] = mesh.boundsMin[k];
+        header.boundsExtent[k] = mesh.boundsExtent[k];
+    }
+    header.radius = mesh.radius;
+
+    std::ofstream file((mesh.path + COOKED_MESH_EXTENSION).c_str(), std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)mesh.fullVertexData.data(), sizeof(GLfloat) * header.vertexCount * MESH_STRIDE);
+    file.write((const char*)mesh.packedVertexData.data(), sizeof(PackedVertex) * mesh.packedVertexData.size());
+    file.write((const char*)mesh.indices.data(), sizeof(GLuint) * mesh.indices.size());
+    file.write((const char*)mesh.lodIndices.data(), sizeof(GLuint) * mesh.lodIndices.size());
+    file.write((const char*)mesh.lods.data(), sizeof(MeshLod) * mesh.lods.size());
+    return file.good();
+}
+
+//Maps <path>.mesh and checks it against the OBJ. Stale, truncated or old version files are rejected.
+//On success the mesh's vertex and index pointers, counts, level table and bounds come from the file
+// @param mesh - Mesh whose path is set. A missing OBJ trusts the cooked file as is
+inline bool openCookedMesh(Mesh& mesh) {
+    MappedFile& file = mesh.cooked;
+    if (!file.open(mesh.path + COOKED_MESH_EXTENSION))
+        return false;
+
+    CookedMeshHeader header;
+    bool valid = file.size >= sizeof(header);
+    if (valid) {
+        std::memcpy(&header, file.data, sizeof(header));
+        valid = header.magic == COOKED_MESH_MAGIC && header.version == COOKED_MESH_VERSION &&
+            header.stride == MESH_STRIDE &&
+            file.size == sizeof(header) + (sizeof(GLfloat) * MESH_STRIDE + sizeof(PackedVertex)) * (size_t)header.vertexCount +
+            sizeof(GLuint) * (size_t)header.indexCount + sizeof(MeshLod) * (size_t)header.lodCount &&
+            header.lodCount > 0 && header.lodCount <= MESH_LOD_MAX;    //Per level arrays are sized MESH_LOD_MAX
+    }
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    if (valid && sourceStamp(mesh.path, sourceSize, sourceTime))
+        valid = sourceSize == header.sourceSize && sourceTime == header.sourceTime;
+
+    if (!valid) {
+        file.close();
+        return false;
+    }
+    const GLfloat* vertices = (const GLfloat*)(file.data + sizeof(header));
+    const PackedVertex* packedVertices = (const PackedVertex*)(vertices + (size_t)header.vertexCount * MESH_STRIDE);
+    const GLuint* indices = (const GLuint*)(packedVertices + header.vertexCount);
+    const MeshLod* table = (const MeshLod*)(indices + header.indexCount);
+    mesh.lods.assign(table, table + header.lodCount);
+    for (size_t i = 0; i < mesh.lods.size(); i++)
+        if ((uint64_t)mesh.lods[i].firstIndex + mesh.lods[i].indexCount > (uint64_t)header.indexCount) {
+            mesh.lods.clear();
+            file.close();
+            return false;
+        }
+
+    mesh.cookedVertices = vertices;
+    mesh.cookedPackedVertices = packedVertices;
+    mesh.cookedIndices = indices;
+    mesh.cookedIndexCount = (GLsizei)header.indexCount;
+    mesh.vertexCount = (GLsizei)header.vertexCount;
+    mesh.indexCount = (GLsizei)mesh.lods[0].indexCount;
+    mesh.center = glm::vec3(header.center[0], header.center[1], header.center[2]);
+    mesh.radius = header.radius;
+    mesh.boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+    mesh.boundsExtent = glm::vec3(header.boundsExtent[0], header.boundsExtent[1], header.boundsExtent[2]);
+    return true;
+}
+
+//Interleaved vertex data, inside the cooked mapping or the parsed copy
+inline const GLfloat* meshVertices(const Mesh& mesh) {
+    return mesh.cookedVertices ? mesh.cookedVertices : mesh.fullVertexData.data();
+}
+
+//Box of the positions, and a bounding sphere around its middle
+inline void meshBounds(Mesh& mesh) {
+    const GLfloat* vertices = meshVertices(mesh);
+    glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+    for (size_t v = 0; v < (size_t)mesh.vertexCount; v++) {
+        glm::vec3 p(vertices[v * MESH_STRIDE], vertices[v * MESH_STRIDE + 1], vertices[v * MESH_STRIDE + 2]);
+        low = glm::min(low, p);
+        high = glm::max(high, p);
+    }
+    if (!mesh.vertexCount)
+        low = high = glm::vec3(0.f);
+    mesh.boundsMin = low;
+    mesh.boundsExtent = high - low;
+    mesh.center = (low + high) * 0.5f;
+    mesh.radius = 0.f;
+    for (size_t v = 0; v < (size_t)mesh.vertexCount; v++) {
+        glm::vec3 p(vertices[v * MESH_STRIDE], vertices[v * MESH_STRIDE + 1], vertices[v * MESH_STRIDE + 2]);
+        mesh.radius = std::max(mesh.radius, glm::length(p - mesh.center));
+    }
+}
+
+//Fills the mesh from its cooked file, or parses, optimizes, builds the LOD chain and cooks the OBJ for next time
+inline void loadMesh(Mesh& mesh) {
+    if (openCookedMesh(mesh))
+        return;
+
+    if (parseObj(mesh.path, mesh.fullVertexData, mesh.indices)) {
+        optimizeVertexCache(mesh.indices, (int)(mesh.fullVertexData.size() / MESH_STRIDE));
+        optimizeVertexFetch(mesh.fullVertexData, MESH_STRIDE, mesh.indices);
+    }
+    mesh.vertexCount = (GLsizei)(mesh.fullVertexData.size() / MESH_STRIDE);
+    mesh.indexCount = (GLsizei)mesh.indices.size();
+    meshBounds(mesh);
+    buildLodChain(mesh.fullVertexData, MESH_STRIDE, mesh.indices, mesh.radius, mesh.lodIndices, mesh.lods);
+    //Quantized here so the GL thread only copies. Same bounds as meshBounds
+    packVertices(mesh.fullVertexData.data(), mesh.vertexCount, MESH_STRIDE, mesh.boundsMin, mesh.boundsExtent, mesh.packedVertexData);
+    if (mesh.indexCount)
+        writeCookedMesh(mesh);
+}
+
+//Picks the coarsest level whose simplification error projects to under MESH_LOD_PIXEL_ERROR pixels
+// @param viewCenter - Bounding sphere center in view space
+// @param scale - Largest axis scale of the instance
+// @param projection - Perspective or orthographic projection
+// @param screenHeight - Viewport height in pixels
+inline int selectLod(const Mesh& mesh, const glm::vec3& viewCenter, float scale, const glm::mat4& projection, float screenHeight) {
+    if (mesh.lods.size() < 2)
+        return 0;
+
+    float pixelsPerUnit = projection[1][1] * screenHeight * 0.5f * scale;
+    if (projection[3][3] == 0.f) {  //Perspective shrinks with distance
+        float depth = -viewCenter.z - mesh.radius * scale;  //Nearest point of the bounding sphere
+        if (depth <= 0.f)
+            return 0;   //Camera is inside or right at the sphere
+        pixelsPerUnit /= depth;
+    }
+
+    int lod = 0;
+    while (lod + 1 < (int)mesh.lods.size() && mesh.lods[lod + 1].error * pixelsPerUnit <= MESH_LOD_PIXEL_ERROR)
+        lod++;
+    return lod;
+}
+
+//Indices of one level, lods[lod].indexCount of them. Level 0 has mesh.indexCount
+inline const GLuint* lodIndexData(const Mesh& mesh, int lod) {
+    if (lod <= 0 || lod >= (int)mesh.lods.size())
+        return mesh.cookedIndices ? mesh.cookedIndices : mesh.indices.data();
+    if (mesh.cookedIndices)
+        return mesh.cookedIndices + mesh.lods[lod].firstIndex;
+    return mesh.lodIndices.data() + (mesh.lods[lod].firstIndex - mesh.indexCount);   //firstIndex counts level 0 too
+}
+
+//Sets the attribute pointers for PackedVertex on the bound VBO
+inline void packedVertexAttributes() {
+    GLsizei stride = sizeof(PackedVertex);
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, position));  //Pos in bounds, 0-1
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, normal));             //Octahedral normal
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offsetof(PackedVertex, uv));           //UV
+    glVertexAttribPointer(3, 4, GL_BYTE, GL_TRUE, stride, (void*)offsetof(PackedVertex, tangent));             //Tangent + handedness
+    glEnableVertexAttribArray(3);
+    glEnableVertexAttribArray(2);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(0);
+    glDisableVertexAttribArray(4);  //Bitangent is rebuilt in the shader
+}
+
+//Generates the VAO, VBO and EBO for a loaded mesh. Cooked meshes upload straight from the mapping, which stays open
+// @param pack - Upload the PackedVertex stream built while loading instead of the 14 floats
+inline void uploadMesh(Mesh& mesh, bool pack) {
+    const GLfloat* vertices = meshVertices(mesh);
+
+    glGenVertexArrays(1, &mesh.VAO);
+    glGenBuffers(1, &mesh.VBO);
+    glGenBuffers(1, &mesh.EBO);
+
+    glState().bindVertexArray(mesh.VAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.EBO);   //Stays bound to the VAO
+    size_t lodIndexCount = mesh.lodIndices.size();
+    if (mesh.cookedIndices)     //Every level is already back to back in the mapping
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * (size_t)mesh.cookedIndexCount, mesh.cookedIndices, GL_STATIC_DRAW);
+    else {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * ((size_t)mesh.indexCount + lodIndexCount), NULL, GL_STATIC_DRAW);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(GLuint) * (size_t)mesh.indexCount, mesh.indices.data());
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * (size_t)mesh.indexCount, sizeof(GLuint) * lodIndexCount, mesh.lodIndices.data());
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
+
+    mesh.packed = pack;
+    if (pack) {
+        const PackedVertex* packedData = mesh.cookedPackedVertices ? mesh.cookedPackedVertices : mesh.packedVertexData.data();
+        glBufferData(GL_ARRAY_BUFFER, sizeof(PackedVertex) * (size_t)mesh.vertexCount, packedData, GL_STATIC_DRAW);
+        packedVertexAttributes();
+    }
+    else {
+        glBufferData(
+            GL_ARRAY_BUFFER,
+            sizeof(GLfloat) * (size_t)mesh.vertexCount * MESH_STRIDE,
+            vertices,
+            GL_STATIC_DRAW    //Shared by every instance, never rewritten
+        );
+
+        //Position
+        glVertexAttribPointer(
+            0,  //Index0 = Pos, Index1 = Color, Index 2 = UV
+            3,  //3 floats: X,Y,Z
+            GL_FLOAT,
+            GL_FALSE,
+            //Number of floats per array
+            MESH_STRIDE * sizeof(GLfloat), //14 total: XYZ, normal XYZ, UV, T(x,y,z), Bitan(x,y,z)
+            (void*)0
+        );
+
+        //Normals
+        GLintptr normPtr = 3 * sizeof(GLfloat);
+        glVertexAttribPointer(
+            1, //Index 1
+            3, //3 floats: normal XYZ
+            GL_FLOAT,
+            GL_TRUE, //Yes, normalize
+            MESH_STRIDE * sizeof(GLfloat),
+            (void*)normPtr
+        );
+
+        //UV
+        GLintptr uvPtr = 6 * sizeof(GLfloat); //Start offset at Index listed in Vertex Array Data
+        glVertexAttribPointer(
+            2, //Index 2
+            2, //2 floats: U,V
+            GL_FLOAT,
+            GL_FALSE,
+            MESH_STRIDE * sizeof(GLfloat),
+            (void*)uvPtr
+        );
+
+        //Tangents
+        GLintptr tangentPtr = 8 * sizeof(GLfloat);
+        glVertexAttribPointer(
+            3,
+            3, //T(x,y,z)
+            GL_FLOAT,
+            GL_FALSE,
+            MESH_STRIDE * sizeof(GLfloat),
+            (void*)tangentPtr
+        );
+
+        //Bitangents
+        GLintptr bitangentPtr = 11 * sizeof(GLfloat);
+        glVertexAttribPointer(
+            4,
+            3,  //B(x,y,z)
+            GL_FLOAT,
+            GL_FALSE,
+            MESH_STRIDE * sizeof(GLfloat),
+            (void*)bitangentPtr
+        );
+
+        glEnableVertexAttribArray(4);
+        glEnableVertexAttribArray(3);
+        glEnableVertexAttribArray(2);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(0);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glState().bindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    std::vector<PackedVertex>().swap(mesh.packedVertexData);    //Only the GPU copy is drawn from
+}
+
+//Meshes keyed by file path so each file is parsed and uploaded once
+class MeshCache {
+public:
+    std::unordered_map<std::string, Mesh*> meshes;
+    AssetPipeline* pipeline = NULL;     //Parse on its workers and upload from its GL queue when set
+    bool packVertices = true;           //Upload new meshes as 20 byte PackedVertex instead of 56 byte floats
+
+    //Returns the mesh for a file, loading it on first use.
+    //With a pipeline the mesh is empty until its upload step has run
+    // @param path - String of the 3D obj's location
+    Mesh* acquire(const std::string& path) {
+        std::unordered_map<std::string, Mesh*>::iterator found = meshes.find(path);
+        if (found == meshes.end()) {
+            Mesh* mesh = new Mesh();
+            mesh->path = path;
+            if (pipeline) {
+                mesh->loading = true;
+                pipeline->submit([mesh] { loadMesh(*mesh); },
+                    [this, mesh] {
+                        mesh->loading = false;
+                        if (mesh->refCount == 0)
+                            destroy(mesh);  //Released while loading
+                        else
+                            upload(mesh);
+                    });
+            }
+            else
+                loadMesh(*mesh);
+            found = meshes.insert(std::make_pair(path, mesh)).first;
+        }
+        found->second->refCount++;
+        return found->second;
+    }
+
+    //Creates the GPU buffers once the data is in. Needs a current GL context
+    void upload(Mesh* mesh) {
+        if (mesh && !mesh->loading && mesh->VAO == 0)
+            uploadMesh(*mesh, packVertices);
+    }
+
+    //Drops one reference. The last one frees the buffers and the CPU copy or mapping
+    void release(Mesh* mesh) {
+        if (!mesh || --mesh->refCount > 0)
+            return;
+        meshes.erase(mesh->path);
+        if (!mesh->loading)
+            destroy(mesh);  //Otherwise the pipeline's upload step frees it
+    }
+
+private:
+    void destroy(Mesh* mesh) {
+        if (mesh->VAO) {
+            glState().deletedVertexArray(mesh->VAO);
+            glDeleteVertexArrays(1, &mesh->VAO);
+            glDeleteBuffers(1, &mesh->VBO);
+            glDeleteBuffers(1, &mesh->EBO);
+        }
+        delete mesh;
+    }
+};
+
+#endif
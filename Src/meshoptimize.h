@@ -0,0 +1,158 @@
+#ifndef MESH_OPTIMIZE_FILE
+#define MESH_OPTIMIZE_FILE
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#define VERTEX_CACHE_SIZE 32        //Modelled post-transform cache entries
+#define VERTEX_CACHE_DECAY 1.5f     //How fast the score drops further back in the cache
+#define VERTEX_LAST_TRI_SCORE 0.75f //Vertices of the triangle just emitted
+#define VERTEX_VALENCE_SCALE 2.f    //Boost for vertices with few triangles left
+#define VERTEX_VALENCE_POWER 0.5f
+
+//Forsyth score of a vertex from its cache slot (-1 = not cached) and remaining triangles
+inline float vertexCacheScore(int cachePos, int valence) {
+    if (valence == 0)
+        return -1.f;    //Nothing left to draw with it
+
+    float score = 0.f;
+    if (cachePos >= 0) {
+        if (cachePos < 3)
+            score = VERTEX_LAST_TRI_SCORE;  //Fixed so the triangle just used isn't preferred over its neighbours
+        else
+            score = std::pow(1.f - (float)(cachePos - 3) / (VERTEX_CACHE_SIZE - 3), VERTEX_CACHE_DECAY);
+    }
+    return score + VERTEX_VALENCE_SCALE * std::pow((float)valence, -VERTEX_VALENCE_POWER);
+}
+
+//Reorders triangles so vertices are reused while still in the post-transform cache (Forsyth's linear speed method)
+// @param indices - Triangle list, rewritten in place
+// @param vertexCount - Number of vertices the indices refer to
+inline void optimizeVertexCache(std::vector<unsigned int>& indices, int vertexCount) {
+    int triCount = (int)indices.size() / 3;
+    if (triCount == 0)
+        return;
+
+    //Triangles using each vertex
+    std::vector<int> valence(vertexCount, 0);
+    for (size_t i = 0; i < indices.size(); i++)
+        valence[indices[i]]++;
+    std::vector<int> adjStart(vertexCount + 1, 0);
+    for (int v = 0; v < vertexCount; v++)
+        adjStart[v + 1] = adjStart[v] + valence[v];
+    std::vector<int> adjacency(adjStart[vertexCount]);
+    std::vector<int> fill(adjStart.begin(), adjStart.end() - 1);
+    for (int t = 0; t < triCount; t++)
+        for (int c = 0; c < 3; c++)
+            adjacency[fill[indices[t * 3 + c]]++] = t;
+
+    std::vector<int> cachePos(vertexCount, -1);
+    std::vector<float> vertScore(vertexCount);
+    for (int v = 0; v < vertexCount; v++)
+        vertScore[v] = vertexCacheScore(-1, valence[v]);
+
+    std::vector<float> triScore(triCount);
+    std::vector<char> emitted(triCount, 0);
+    for (int t = 0; t < triCount; t++)
+        triScore[t] = vertScore[indices[t * 3]] + vertScore[indices[t * 3 + 1]] + vertScore[indices[t * 3 + 2]];
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    int cache[VERTEX_CACHE_SIZE + 3];
+    int cacheCount = 0;
+    int scanCursor = 0;     //Next triangle to try when nothing in the cache is left
+
+    int best = 0;
+    for (int t = 1; t < triCount; t++)
+        if (triScore[t] > triScore[best])
+            best = t;
+
+    for (int emittedCount = 0; emittedCount < triCount; emittedCount++) {
+        if (best < 0) {
+            while (emitted[scanCursor])
+                scanCursor++;
+            best = scanCursor;
+        }
+
+        const unsigned int* tri = &indices[best * 3];
+        output.insert(output.end(), tri, tri + 3);
+        emitted[best] = 1;
+
+        //Drop the triangle from its vertices' lists
+        for (int c = 0; c < 3; c++) {
+            int v = tri[c];
+            int* list = &adjacency[adjStart[v]];
+            for (int k = 0; k < valence[v]; k++)
+                if (list[k] == best) {
+                    list[k] = list[valence[v] - 1];
+                    break;
+                }
+            valence[v]--;
+        }
+
+        //The triangle's vertices move to the front, the rest shift back
+        int newCache[VERTEX_CACHE_SIZE + 3];
+        int newCount = 0;
+        for (int c = 0; c < 3; c++)
+            newCache[newCount++] = tri[c];
+        for (int i = 0; i < cacheCount; i++) {
+            int v = cache[i];
+            if (v != (int)tri[0] && v != (int)tri[1] && v != (int)tri[2])
+                newCache[newCount++] = v;
+        }
+        for (int i = VERTEX_CACHE_SIZE; i < newCount; i++)
+            cachePos[newCache[i]] = -1;     //Pushed out
+        cacheCount = std::min(newCount, VERTEX_CACHE_SIZE);
+        std::memcpy(cache, newCache, sizeof(int) * cacheCount);
+
+        //Rescore everything that moved, then pick the best triangle touching the cache
+        for (int i = 0; i < newCount; i++) {
+            int v = newCache[i];
+            if (i < VERTEX_CACHE_SIZE)
+                cachePos[v] = i;
+            vertScore[v] = vertexCacheScore(cachePos[v], valence[v]);
+        }
+        best = -1;
+        float bestScore = -1.f;
+        for (int i = 0; i < newCount; i++) {
+            int v = newCache[i];
+            for (int k = 0; k < valence[v]; k++) {
+                int t = adjacency[adjStart[v] + k];
+                float score = vertScore[indices[t * 3]] + vertScore[indices[t * 3 + 1]] + vertScore[indices[t * 3 + 2]];
+                triScore[t] = score;
+                if (score > bestScore) {
+                    bestScore = score;
+                    best = t;
+                }
+            }
+        }
+    }
+    indices.swap(output);
+}
+
+//Renumbers vertices in the order the indices first use them so vertex fetches walk memory forwards.
+//Unused vertices are dropped
+// @param vertices - Interleaved vertex data, rewritten in place
+// @param stride - Floats per vertex
+// @param indices - Rewritten to the new numbering
+inline void optimizeVertexFetch(std::vector<float>& vertices, int stride, std::vector<unsigned int>& indices) {
+    int vertexCount = (int)vertices.size() / stride;
+    std::vector<int> remap(vertexCount, -1);
+    std::vector<float> reordered;
+    reordered.reserve(vertices.size());
+
+    int next = 0;
+    for (size_t i = 0; i < indices.size(); i++) {
+        int v = indices[i];
+        if (remap[v] < 0) {
+            remap[v] = next++;
+            reordered.insert(reordered.end(), vertices.begin() + v * stride, vertices.begin() + (v + 1) * stride);
+        }
+        indices[i] = remap[v];
+    }
+    vertices.swap(reordered);
+}
+
+#endif
@@ -0,0 +1,293 @@
+#ifndef MESH_SIMPLIFY_FILE
+#define MESH_SIMPLIFY_FILE
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cfloat>
+#include "meshoptimize.h"
+
+#define MESH_LOD_MAX 4                  //Levels including the full mesh
+#define MESH_LOD_REDUCTION 0.5f         //Each level aims for this fraction of the previous level's triangles
+#define MESH_LOD_MIN_GAIN 0.85f         //A level keeping more than this fraction of the previous one ends the chain
+#define MESH_LOD_MAX_ERROR 0.05f        //Largest allowed deviation, as a fraction of the mesh radius
+#define MESH_LOD_MIN_TRIANGLES 32       //Don't simplify below this
+
+//One level of detail inside a mesh's index buffer
+struct MeshLod {
+    uint32_t firstIndex;    //Offset into the combined index buffer
+    uint32_t indexCount;
+    float error;            //Approximate distance from the full mesh, in mesh units
+};
+
+//Symmetric 4x4 error quadric (Garland & Heckbert) plus the area it was built from
+struct Quadric {
+    double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+    double weight;
+
+    void clear() { std::memset(this, 0, sizeof(Quadric)); }
+
+    //Adds the squared distance to the plane n.p + d = 0, scaled by w
+    void addPlane(double nx, double ny, double nz, double d, double w) {
+        a00 += w * nx * nx; a01 += w * nx * ny; a02 += w * nx * nz; a03 += w * nx * d;
+        a11 += w * ny * ny; a12 += w * ny * nz; a13 += w * ny * d;
+        a22 += w * nz * nz; a23 += w * nz * d;
+        a33 += w * d * d;
+        weight += w;
+    }
+
+    void add(const Quadric& q) {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+        a11 += q.a11; a12 += q.a12; a13 += q.a13;
+        a22 += q.a22; a23 += q.a23;
+        a33 += q.a33;
+        weight += q.weight;
+    }
+
+    //Weighted squared distance of p to all planes
+    double evaluate(const float* p) const {
+        double x = p[0], y = p[1], z = p[2];
+        return a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x +
+            a11 * y * y + 2 * a12 * y * z + 2 * a13 * y +
+            a22 * z * z + 2 * a23 * z +
+            a33;
+    }
+};
+
+//RMS distance in mesh units of p to the planes of a quadric pair
+inline float collapseError(const Quadric& a, const Quadric& b, const float* p) {
+    double weight = a.weight + b.weight;
+    if (weight <= 0.0)
+        return 0.f;
+    double error = (a.evaluate(p) + b.evaluate(p)) / weight;
+    return (float)std::sqrt(std::max(error, 0.0));
+}
+
+//Unnormalized face normal of triangle a, b, c
+inline void triangleNormal(const float* a, const float* b, const float* c, float* n) {
+    float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+//Reduces a triangle list by collapsing edges onto one of their endpoints, cheapest quadric error first.
+//Vertices are never moved or created, so every level can share the original vertex buffer.
+//Vertices on open borders or UV/normal seams (several vertices at one position) stay put so the surface doesn't tear
+// @param vertices - Interleaved vertex data, XYZ first
+// @param vertexCount - Number of vertices
+// @param stride - Floats per vertex
+// @param indices - Triangle list to simplify
+// @param targetIndexCount - Stop once the list is this short
+// @param maxError - Refuse collapses that move the surface further than this (mesh units)
+// @param out - Receives the simplified triangle list
+// @returns The largest error introduced
+inline float simplifyMesh(const float* vertices, int vertexCount, int stride, const std::vector<unsigned int>& indices,
+    size_t targetIndexCount, float maxError, std::vector<unsigned int>& out) {
+    out = indices;
+    if (vertexCount == 0 || out.size() <= targetIndexCount)
+        return 0.f;
+
+    //Vertices sharing a position. More than one means a seam
+    struct PositionHash {
+        size_t operator()(const float* p) const {
+            uint32_t bits[3];
+            std::memcpy(bits, p, sizeof(bits));
+            return (size_t)(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+        }
+    };
+    struct PositionEqual {
+        bool operator()(const float* a, const float* b) const { return a[0] == b[0] && a[1] == b[1] && a[2] == b[2]; }
+    };
+    std::unordered_map<const float*, unsigned int, PositionHash, PositionEqual> positions;
+    std::vector<unsigned int> positionOf(vertexCount);
+    std::vector<int> wedges;
+    for (int v = 0; v < vertexCount; v++) {
+        std::pair<std::unordered_map<const float*, unsigned int, PositionHash, PositionEqual>::iterator, bool> found =
+            positions.insert(std::make_pair(&vertices[(size_t)v * stride], (unsigned int)wedges.size()));
+        if (found.second)
+            wedges.push_back(0);
+        positionOf[v] = found.first->second;
+        wedges[positionOf[v]]++;
+    }
+
+    //Edges by position used by anything but exactly 2 triangles are borders (or non-manifold)
+    std::unordered_map<uint64_t, int> edgeUse;
+    for (size_t i = 0; i < indices.size(); i += 3)
+        for (int e = 0; e < 3; e++) {
+            uint64_t a = positionOf[indices[i + e]], b = positionOf[indices[i + (e + 1) % 3]];
+            if (a != b)
+                edgeUse[a < b ? (a << 32 | b) : (b << 32 | a)]++;
+        }
+    std::vector<char> locked(vertexCount, 0);
+    for (int v = 0; v < vertexCount; v++)
+        locked[v] = wedges[positionOf[v]] > 1;
+    std::vector<char> lockedPosition(wedges.size(), 0);
+    for (std::unordered_map<uint64_t, int>::iterator it = edgeUse.begin(); it != edgeUse.end(); ++it)
+        if (it->second != 2) {
+            lockedPosition[it->first >> 32] = 1;
+            lockedPosition[it->first & 0xffffffffu] = 1;
+        }
+    for (int v = 0; v < vertexCount; v++)
+        locked[v] |= lockedPosition[positionOf[v]];
+
+    //Plane quadric of every triangle, area weighted, summed on its corners
+    std::vector<Quadric> quadrics(vertexCount);
+    for (int v = 0; v < vertexCount; v++)
+        quadrics[v].clear();
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        const float* p[3] = { &vertices[(size_t)indices[i] * stride], &vertices[(size_t)indices[i + 1] * stride], &vertices[(size_t)indices[i + 2] * stride] };
+        float n[3];
+        triangleNormal(p[0], p[1], p[2], n);
+        double length = std::sqrt((double)n[0] * n[0] + (double)n[1] * n[1] + (double)n[2] * n[2]);
+        if (length == 0.0)
+            continue;
+        double nx = n[0] / length, ny = n[1] / length, nz = n[2] / length;
+        double d = -(nx * p[0][0] + ny * p[0][1] + nz * p[0][2]);
+        for (int c = 0; c < 3; c++)
+            quadrics[indices[i + c]].addPlane(nx, ny, nz, d, length * 0.5);
+    }
+
+    struct Collapse {
+        unsigned int from, to;
+        float error;
+        bool operator<(const Collapse& other) const { return error < other.error; }
+    };
+    std::vector<Collapse> collapses;
+    std::vector<int> start, triangleOf;
+    std::vector<unsigned int> remap(vertexCount);
+    std::vector<char> touched(vertexCount);
+    float resultError = 0.f;
+
+    //Collapse in passes. A vertex takes part in at most one collapse per pass so the flip checks stay valid
+    while (out.size() > targetIndexCount) {
+        //Triangles around each vertex
+        start.assign(vertexCount + 1, 0);
+        for (size_t i = 0; i < out.size(); i++)
+            start[out[i] + 1]++;
+        for (int v = 0; v < vertexCount; v++)
+            start[v + 1] += start[v];
+        triangleOf.resize(out.size());
+        std::vector<int> cursor(start.begin(), start.end() - 1);
+        for (size_t i = 0; i < out.size(); i++)
+            triangleOf[cursor[out[i]]++] = (int)(i / 3);
+
+        //Cheapest direction of every edge
+        collapses.clear();
+        for (size_t i = 0; i < out.size(); i += 3)
+            for (int e = 0; e < 3; e++) {
+                unsigned int a = out[i + e], b = out[i + (e + 1) % 3];
+                if (a > b)
+                    continue;   //Each interior edge is seen from both triangles, keep one
+                Collapse best = { 0, 0, FLT_MAX };
+                if (!locked[a]) {
+                    Collapse c = { a, b, collapseError(quadrics[a], quadrics[b], &vertices[(size_t)b * stride]) };
+                    best = c;
+                }
+                if (!locked[b]) {
+                    Collapse c = { b, a, collapseError(quadrics[a], quadrics[b], &vertices[(size_t)a * stride]) };
+                    if (c.error < best.error)
+                        best = c;
+                }
+                if (best.error <= maxError)
+                    collapses.push_back(best);
+            }
+        std::sort(collapses.begin(), collapses.end());
+
+        //Roughly 2 triangles go per collapse
+        size_t limit = std::max<size_t>((out.size() - targetIndexCount) / 6, 1);
+        size_t applied = 0;
+        for (int v = 0; v < vertexCount; v++)
+            remap[v] = v;
+        std::fill(touched.begin(), touched.end(), 0);
+        for (size_t c = 0; c < collapses.size() && applied < limit; c++) {
+            unsigned int from = collapses[c].from, to = collapses[c].to;
+            if (touched[from] || touched[to])
+                continue;
+
+            //Reject collapses that fold a surviving triangle over
+            const float* target = &vertices[(size_t)to * stride];
+            bool flips = false;
+            for (int k = start[from]; k < start[from + 1] && !flips; k++) {
+                const unsigned int* tri = &out[(size_t)triangleOf[k] * 3];
+                if (tri[0] == to || tri[1] == to || tri[2] == to)
+                    continue;   //Degenerates and disappears
+                const float* p[3], * q[3];
+                for (int corner = 0; corner < 3; corner++) {
+                    p[corner] = &vertices[(size_t)tri[corner] * stride];
+                    q[corner] = tri[corner] == from ? target : p[corner];
+                }
+                float before[3], after[3];
+                triangleNormal(p[0], p[1], p[2], before);
+                triangleNormal(q[0], q[1], q[2], after);
+                flips = before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.f;
+            }
+            if (flips)
+                continue;
+
+            remap[from] = to;
+            quadrics[to].add(quadrics[from]);
+            resultError = std::max(resultError, collapses[c].error);
+            applied++;
+            //Neighbours' triangles change shape too, leave them for the next pass
+            for (int k = start[from]; k < start[from + 1]; k++) {
+                const unsigned int* tri = &out[(size_t)triangleOf[k] * 3];
+                touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+            }
+        }
+        if (applied == 0)
+            break;  //Everything left is locked, too costly or would flip
+
+        size_t write = 0;
+        for (size_t i = 0; i < out.size(); i += 3) {
+            unsigned int a = remap[out[i]], b = remap[out[i + 1]], c = remap[out[i + 2]];
+            if (a == b || b == c || a == c)
+                continue;
+            out[write++] = a;
+            out[write++] = b;
+            out[write++] = c;
+        }
+        out.resize(write);
+    }
+    return resultError;
+}
+
+//Builds progressively coarser index lists over the same vertices
+// @param vertices - Interleaved vertex data, XYZ first
+// @param stride - Floats per vertex
+// @param indices - Full detail triangle list (level 0)
+// @param radius - Size of the mesh, scales the error limit
+// @param lodIndices - Receives the lower levels one after another
+// @param lods - Receives every level. Level 0 is indices itself, the rest start after it
+inline void buildLodChain(const std::vector<float>& vertices, int stride, const std::vector<unsigned int>& indices,
+    float radius, std::vector<unsigned int>& lodIndices, std::vector<MeshLod>& lods) {
+    lodIndices.clear();
+    lods.clear();
+    MeshLod full = { 0, (uint32_t)indices.size(), 0.f };
+    lods.push_back(full);
+
+    int vertexCount = (int)(vertices.size() / stride);
+    std::vector<unsigned int> level;
+    while (lods.size() < MESH_LOD_MAX) {
+        size_t previous = lods.back().indexCount;
+        size_t target = (size_t)(previous / 3 * MESH_LOD_REDUCTION) * 3;
+        if (target < MESH_LOD_MIN_TRIANGLES * 3)
+            break;
+
+        //Always from the full mesh so the errors don't compound
+        float error = simplifyMesh(vertices.data(), vertexCount, stride, indices, target, MESH_LOD_MAX_ERROR * radius, level);
+        if (level.size() > previous * MESH_LOD_MIN_GAIN || level.empty())
+            break;
+        optimizeVertexCache(level, vertexCount);
+
+        MeshLod lod = { (uint32_t)(indices.size() + lodIndices.size()), (uint32_t)level.size(), error };
+        lods.push_back(lod);
+        lodIndices.insert(lodIndices.end(), level.begin(), level.end());
+    }
+}
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef MORTON_FILE
+#define MORTON_FILE
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cfloat>
+#include "parallel.h"
+
+#define MORTON_BITS 21              //Bits per axis. 3 * 21 fits in a 64 bit code
+#define RADIX_MIN_PER_THREAD 4096   //Keys per thread before the sort is split
+
+//Spreads the low 21 bits of v so there are 2 zero bits between each
+inline uint64_t expandMortonBits(uint64_t v) {
+    v &= 0x1fffff;
+    v = (v | (v << 32)) & 0x1f00000000ffffULL;
+    v = (v | (v << 16)) & 0x1f0000ff0000ffULL;
+    v = (v | (v << 8)) & 0x100f00f00f00f00fULL;
+    v = (v | (v << 4)) & 0x10c30c30c30c30c3ULL;
+    v = (v | (v << 2)) & 0x1249249249249249ULL;
+    return v;
+}
+
+//Interleaves a position quantized inside the bounds into a 3D Morton code
+inline uint64_t mortonCode(glm::vec3 pos, glm::vec3 boundsMin, glm::vec3 invExtent) {
+    const float maxCell = (float)((1 << MORTON_BITS) - 1);
+    glm::vec3 cell = glm::clamp((pos - boundsMin) * invExtent, 0.f, 1.f) * maxCell;
+    return expandMortonBits((uint64_t)cell.x)
+        | (expandMortonBits((uint64_t)cell.y) << 1)
+        | (expandMortonBits((uint64_t)cell.z) << 2);
+}
+
+//Stable LSD radix sort of keys with their values, 8 bits per pass.
+//Each pass counts and scatters in parallel, and passes where every key shares the same byte are skipped.
+inline void radixSortPairs(std::vector<uint64_t>& keys, std::vector<int>& values) {
+    int count = (int)keys.size();
+    if (count < 2)
+        return;
+
+    //Bytes that actually differ between keys
+    uint64_t allOr = 0, allAnd = ~0ULL;
+    for (int i = 0; i < count; i++) {
+        allOr |= keys[i];
+        allAnd &= keys[i];
+    }
+    uint64_t varying = allOr ^ allAnd;
+
+    int chunks = std::max(1, std::min(workerCount(), count / RADIX_MIN_PER_THREAD));
+    int chunkSize = (count + chunks - 1) / chunks;
+    std::vector<uint64_t> keysTmp(count);
+    std::vector<int> valuesTmp(count);
+    std::vector<int> offsets(chunks * 256);
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        if (((varying >> shift) & 0xff) == 0)
+            continue;
+
+        //Per chunk digit counts
+        std::fill(offsets.begin(), offsets.end(), 0);
+        parallelFor(chunks, 1, [&](int first, int last) {
+            for (int c = first; c < last; c++) {
+                int* histogram = &offsets[c * 256];
+                int end = std::min(count, (c + 1) * chunkSize);
+                for (int i = c * chunkSize; i < end; i++)
+                    histogram[(keys[i] >> shift) & 0xff]++;
+            }
+        });
+
+        //Digit major prefix sum keeps the sort stable across chunks
+        int total = 0;
+        for (int d = 0; d < 256; d++)
+            for (int c = 0; c < chunks; c++) {
+                int digitCount = offsets[c * 256 + d];
+                offsets[c * 256 + d] = total;
+                total += digitCount;
+            }
+
+        parallelFor(chunks, 1, [&](int first, int last) {
+            for (int c = first; c < last; c++) {
+                int* cursor = &offsets[c * 256];
+                int end = std::min(count, (c + 1) * chunkSize);
+                for (int i = c * chunkSize; i < end; i++) {
+                    int dst = cursor[(keys[i] >> shift) & 0xff]++;
+                    keysTmp[dst] = keys[i];
+                    valuesTmp[dst] = values[i];
+                }
+            }
+        });
+
+        keys.swap(keysTmp);
+        values.swap(valuesTmp);
+    }
+}
+
+//Orders particles along a Z curve so particles close in space end up close in memory
+// @param positions - Particle positions
+// @param count - Number of particles
+// @param order - Receives the old index for every new slot (order[newIndex] = oldIndex)
+inline void mortonOrder(const glm::vec3* positions, int count, std::vector<int>& order) {
+    order.resize(count);
+    if (count <= 0)
+        return;
+
+    glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+    for (int i = 0; i < count; i++) {
+        boundsMin = glm::min(boundsMin, positions[i]);
+        boundsMax = glm::max(boundsMax, positions[i]);
+    }
+    glm::vec3 extent = boundsMax - boundsMin;
+    glm::vec3 invExtent = glm::vec3(
+        extent.x > 0.f ? 1.f / extent.x : 0.f,
+        extent.y > 0.f ? 1.f / extent.y : 0.f,
+        extent.z > 0.f ? 1.f / extent.z : 0.f);
+
+    std::vector<uint64_t> codes(count);
+    parallelFor(count, RADIX_MIN_PER_THREAD, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            codes[i] = mortonCode(positions[i], boundsMin, invExtent);
+            order[i] = i;
+        }
+    });
+    radixSortPairs(codes, order);
+}
+
+//Moves items into their new slots
+// @param order - From mortonOrder(). items[newIndex] takes the old items[order[newIndex]]
+template <typename T>
+void applyPermutation(T* items, const std::vector<int>& order) {
+    std::vector<T> moved(order.size());
+    for (size_t i = 0; i < order.size(); i++)
+        moved[i] = items[order[i]];
+    std::copy(moved.begin(), moved.end(), items);
+}
+
+//New slot of every old index, the inverse of a mortonOrder() result
+// @param newIndex - Receives newIndex[oldIndex]
+inline void invertOrder(const std::vector<int>& order, std::vector<int>& newIndex) {
+    newIndex.resize(order.size());
+    for (size_t i = 0; i < order.size(); i++)
+        newIndex[order[i]] = (int)i;
+}
+
+//Rewrites stored particle indices (spring ends, lattice points of render vertices) after a reorder
+// @param indices - Old particle indices. Negative entries are left alone
+// @param order - From mortonOrder()
+inline void remapIndices(int* indices, int indexCount, const std::vector<int>& order) {
+    std::vector<int> newIndex;
+    invertOrder(order, newIndex);
+    for (int i = 0; i < indexCount; i++)
+        if (indices[i] >= 0)
+            indices[i] = newIndex[indices[i]];
+}
+
+#endif
@@ -0,0 +1,375 @@
+#ifndef OBJ_PARSER_FILE
+#define OBJ_PARSER_FILE
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#ifndef TINYOBJLOADER_IMPLEMENTATION   //main.cpp already pulled in the loader with its implementation
+#include "tiny_obj_loader.h"
+#endif
+#include "mappedfile.h"
+#include "parallel.h"
+
+#define OBJ_CHUNK_MIN_BYTES (1 << 20)   //Files smaller than this parse on one thread
+#define OBJ_CHUNKS_PER_THREAD 4         //Extra chunks even out lines of different lengths
+#define OBJ_MAX_POLYGON 64              //Most corners a face may have. Larger faces fail the load
+
+//Parses a decimal float without the C locale. Handles sign, fraction and exponent
+// @param cursor - Start of the number, moved past it
+// @param end - End of the buffer
+inline bool parseObjFloat(const char*& cursor, const char* end, float& value) {
+    static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    const char* c = cursor;
+    bool negative = false;
+    if (c < end && (*c == '-' || *c == '+'))
+        negative = *c++ == '-';
+
+    uint64_t mantissa = 0;
+    int exponent = 0, digits = 0;
+    for (; c < end && *c >= '0' && *c <= '9'; c++, digits++) {
+        if (mantissa < 1000000000000000000ULL)
+            mantissa = mantissa * 10 + (*c - '0');
+        else
+            exponent++;     //Digits past 19 only matter for their magnitude
+    }
+    if (c < end && *c == '.') {
+        for (c++; c < end && *c >= '0' && *c <= '9'; c++, digits++)
+            if (mantissa < 1000000000000000000ULL) {
+                mantissa = mantissa * 10 + (*c - '0');
+                exponent--;
+            }
+    }
+    if (digits == 0)
+        return false;
+
+    if (c < end && (*c == 'e' || *c == 'E')) {
+        const char* e = c + 1;
+        bool negativeExp = false;
+        if (e < end && (*e == '-' || *e == '+'))
+            negativeExp = *e++ == '-';
+        if (e < end && *e >= '0' && *e <= '9') {
+            int explicitExp = 0;
+            for (; e < end && *e >= '0' && *e <= '9'; e++)
+                explicitExp = std::min(explicitExp * 10 + (*e - '0'), 1000);
+            exponent += negativeExp ? -explicitExp : explicitExp;
+            c = e;
+        }
+    }
+
+    double result = (double)mantissa;
+    while (exponent > 22) {
+        result *= 1e22;
+        exponent -= 22;
+    }
+    while (exponent < -22) {
+        result /= 1e22;
+        exponent += 22;
+    }
+    result = exponent >= 0 ? result * powers[exponent] : result / powers[-exponent];
+    value = (float)(negative ? -result : result);
+    cursor = c;
+    return true;
+}
+
+//Parses a face index. Negative indices count back from the last element read so far
+inline bool parseObjInt(const char*& cursor, const char* end, int& value) {
+    const char* c = cursor;
+    bool negative = false;
+    if (c < end && (*c == '-' || *c == '+'))
+        negative = *c++ == '-';
+    if (c >= end || *c < '0' || *c > '9')
+        return false;
+    int result = 0;
+    for (; c < end && *c >= '0' && *c <= '9'; c++)
+        result = result * 10 + (*c - '0');
+    value = negative ? -result : result;
+    cursor = c;
+    return true;
+}
+
+//Start of the line holding c, for error messages
+inline const char* lineStart(const char* c, const char* begin) {
+    while (c > begin && c[-1] != '\n')
+        c--;
+    return c;
+}
+
+//Everything one chunk of lines produced. Indices are local to the chunk until merged
+struct ObjChunk {
+    struct ShapeBreak {
+        size_t corner;      //Corners before this belong to the previous shape
+        std::string name;
+    };
+
+    std::vector<tinyobj::real_t> vertices, normals, texcoords;
+    std::vector<tinyobj::index_t> corners;  //Already triangulated, 3 per triangle
+    std::vector<unsigned char> relative;    //Per corner: 1 vertex, 2 normal, 4 texcoord index needs the chunk base
+    bool anyRelative = false;               //relative stays empty until a negative index shows up
+    std::vector<ShapeBreak> breaks;
+    std::vector<size_t> quads;              //First corner of every quad. Its diagonal is picked once all positions are known
+    std::string error;
+};
+
+//Parses whole lines in [begin, end). Handles v, vn, vt, f, o and g; other statements are skipped
+inline void parseObjChunk(const char* begin, const char* end, ObjChunk& chunk) {
+    tinyobj::index_t polygon[OBJ_MAX_POLYGON];
+    unsigned char polygonRelative[OBJ_MAX_POLYGON];
+    const char* line = begin;
+
+    while (line < end) {
+        const char* lineEnd = (const char*)std::memchr(line, '\n', end - line);
+        if (!lineEnd)
+            lineEnd = end;
+        const char* c = line;
+        line = lineEnd + 1;
+
+        while (c < lineEnd && (*c == ' ' || *c == '\t'))
+            c++;
+        if (c >= lineEnd || *c == '#' || *c == '\r')
+            continue;
+
+        if (c[0] == 'v' && c + 1 < lineEnd && (c[1] == ' ' || c[1] == '\t' || c[1] == 'n' || c[1] == 't')) {
+            std::vector<tinyobj::real_t>* target = &chunk.vertices;
+            int components = 3;
+            if (c[1] == 'n')
+                target = &chunk.normals;
+            else if (c[1] == 't') {
+                target = &chunk.texcoords;
+                components = 2;
+            }
+            c += c[1] == ' ' || c[1] == '\t' ? 1 : 2;
+            for (int k = 0; k < components; k++) {
+                while (c < lineEnd && (*c == ' ' || *c == '\t'))
+                    c++;
+                float value = 0.f;
+                if (!parseObjFloat(c, lineEnd, value) && k < (components == 2 ? 1 : 3)) {
+                    chunk.error = "Bad number in: " + std::string(lineStart(c, begin), lineEnd);
+                    return;
+                }
+                target->push_back(value);   //A missing V in vt reads as 0
+            }
+        }
+        else if (c[0] == 'f' && c + 1 < lineEnd && (c[1] == ' ' || c[1] == '\t')) {
+            int count = 0;
+            c++;
+            int vertexCount = (int)chunk.vertices.size() / 3;
+            int normalCount = (int)chunk.normals.size() / 3;
+            int texcoordCount = (int)chunk.texcoords.size() / 2;
+            for (;;) {
+                while (c < lineEnd && (*c == ' ' || *c == '\t' || *c == '\r'))
+                    c++;
+                if (c >= lineEnd)
+                    break;
+
+                //v, v/vt, v//vn or v/vt/vn
+                int v = 0, vt = 0, vn = 0;
+                if (!parseObjInt(c, lineEnd, v) || v == 0) {
+                    chunk.error = "Bad face in: " + std::string(lineStart(c, begin), lineEnd);
+                    return;
+                }
+                if (c < lineEnd && *c == '/') {
+                    c++;
+                    if (c < lineEnd && *c != '/')
+                        parseObjInt(c, lineEnd, vt);
+                    if (c < lineEnd && *c == '/') {
+                        c++;
+                        parseObjInt(c, lineEnd, vn);
+                    }
+                }
+                if (count == OBJ_MAX_POLYGON) {
+                    chunk.error = "Face with more than " + std::to_string(OBJ_MAX_POLYGON) + " corners in: " + std::string(lineStart(c, begin), lineEnd);
+                    return;
+                }
+
+                //1 based, or negative counting back from what this chunk has read. Relative ones get the chunk base added on merge
+                unsigned char relativeBits = 0;
+                tinyobj::index_t& corner = polygon[count];
+                corner.vertex_index = v > 0 ? v - 1 : vertexCount + v;
+                corner.texcoord_index = vt > 0 ? vt - 1 : (vt < 0 ? texcoordCount + vt : -1);
+                corner.normal_index = vn > 0 ? vn - 1 : (vn < 0 ? normalCount + vn : -1);
+                if (v < 0)
+                    relativeBits |= 1;
+                if (vn < 0)
+                    relativeBits |= 2;
+                if (vt < 0)
+                    relativeBits |= 4;
+                polygonRelative[count++] = relativeBits;
+            }
+
+            //Fan triangulation, same as tinyobj. Quads start as [0, 1, 2], [0, 2, 3]
+            if (count == 4)
+                chunk.quads.push_back(chunk.corners.size());
+            for (int i = 1; i + 1 < count; i++) {
+                int fan[3] = { 0, i, i + 1 };
+                for (int k = 0; k < 3; k++) {
+                    if (polygonRelative[fan[k]] && !chunk.anyRelative) {
+                        chunk.relative.assign(chunk.corners.size(), 0);
+                        chunk.anyRelative = true;
+                    }
+                    chunk.corners.push_back(polygon[fan[k]]);
+                    if (chunk.anyRelative)
+                        chunk.relative.push_back(polygonRelative[fan[k]]);
+                }
+            }
+        }
+        else if ((c[0] == 'o' || c[0] == 'g') && (c + 1 == lineEnd || c[1] == ' ' || c[1] == '\t' || c[1] == '\r')) {
+            c++;
+            while (c < lineEnd && (*c == ' ' || *c == '\t'))
+                c++;
+            const char* nameEnd = lineEnd;
+            while (nameEnd > c && (nameEnd[-1] == '\r' || nameEnd[-1] == ' ' || nameEnd[-1] == '\t'))
+                nameEnd--;
+            ObjChunk::ShapeBreak shapeBreak = { chunk.corners.size(), std::string(c, nameEnd) };
+            chunk.breaks.push_back(shapeBreak);
+        }
+    }
+}
+
+//Reads an OBJ with every core parsing its own run of lines, then stitches the results together.
+//Fills the same structures as tinyobj::LoadObj (triangulated) apart from materials and vertex colors
+// @param path - String of the 3D obj's location
+// @param attributes - Receives positions, normals and UVs
+// @param shapes - Receives one shape per o/g group that has faces
+// @param error - Receives the reason on failure
+inline bool loadObjParallel(const std::string& path, tinyobj::attrib_t& attributes,
+    std::vector<tinyobj::shape_t>& shapes, std::string& error) {
+    attributes = tinyobj::attrib_t();
+    shapes.clear();
+
+    MappedFile file;
+    if (!file.open(path)) {
+        error = "Cannot open " + path;
+        return false;
+    }
+    const char* text = (const char*)file.data;
+    const char* textEnd = text + file.size;
+
+    //Chunk edges moved forward to the next line start
+    int chunkCount = (int)std::max<size_t>(1, std::min<size_t>(file.size / OBJ_CHUNK_MIN_BYTES,
+        (size_t)workerCount() * OBJ_CHUNKS_PER_THREAD));
+    std::vector<const char*> edges(chunkCount + 1);
+    edges[0] = text;
+    edges[chunkCount] = textEnd;
+    for (int i = 1; i < chunkCount; i++) {
+        const char* edge = std::max(edges[i - 1], text + file.size / chunkCount * i);
+        const char* newline = (const char*)std::memchr(edge, '\n', textEnd - edge);
+        edges[i] = newline ? newline + 1 : textEnd;
+    }
+
+    std::vector<ObjChunk> chunks(chunkCount);
+    parallelFor(chunkCount, 1, [&](int first, int last) {
+        for (int i = first; i < last; i++)
+            parseObjChunk(edges[i], edges[i + 1], chunks[i]);
+    });
+
+    //Where each chunk's elements land in the merged arrays
+    size_t vertexFloats = 0, normalFloats = 0, texcoordFloats = 0, cornerTotal = 0;
+    std::vector<size_t> vertexBase(chunkCount), normalBase(chunkCount), texcoordBase(chunkCount), cornerBase(chunkCount);
+    for (int i = 0; i < chunkCount; i++) {
+        if (!chunks[i].error.empty()) {
+            error = path + ": " + chunks[i].error;
+            return false;
+        }
+        vertexBase[i] = vertexFloats;
+        normalBase[i] = normalFloats;
+        texcoordBase[i] = texcoordFloats;
+        cornerBase[i] = cornerTotal;
+        vertexFloats += chunks[i].vertices.size();
+        normalFloats += chunks[i].normals.size();
+        texcoordFloats += chunks[i].texcoords.size();
+        cornerTotal += chunks[i].corners.size();
+    }
+    attributes.vertices.resize(vertexFloats);
+    attributes.normals.resize(normalFloats);
+    attributes.texcoords.resize(texcoordFloats);
+    std::vector<tinyobj::index_t> corners(cornerTotal);
+
+    //Copy out and rebase relative indices in parallel
+    std::vector<char> badIndex(chunkCount, 0);
+    parallelFor(chunkCount, 1, [&](int first, int last) {
+        for (int i = first; i < last; i++) {
+            ObjChunk& chunk = chunks[i];
+            std::copy(chunk.vertices.begin(), chunk.vertices.end(), attributes.vertices.begin() + vertexBase[i]);
+            std::copy(chunk.normals.begin(), chunk.normals.end(), attributes.normals.begin() + normalBase[i]);
+            std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), attributes.texcoords.begin() + texcoordBase[i]);
+
+            int vertexOffset = (int)(vertexBase[i] / 3), normalOffset = (int)(normalBase[i] / 3), texcoordOffset = (int)(texcoordBase[i] / 2);
+            for (size_t c = 0; c < chunk.corners.size(); c++) {
+                tinyobj::index_t corner = chunk.corners[c];
+                unsigned char bits = chunk.anyRelative ? chunk.relative[c] : 0;
+                if (bits & 1)
+                    corner.vertex_index += vertexOffset;
+                if (bits & 2)
+                    corner.normal_index += normalOffset;
+                if (bits & 4)
+                    corner.texcoord_index += texcoordOffset;
+                //-1 means no normal or UV, unless it came from a relative index reaching back too far
+                if (corner.vertex_index < 0 || corner.vertex_index >= (int)(vertexFloats / 3) ||
+                    corner.normal_index < ((bits & 2) ? 0 : -1) || corner.normal_index >= (int)(normalFloats / 3) ||
+                    corner.texcoord_index < ((bits & 4) ? 0 : -1) || corner.texcoord_index >= (int)(texcoordFloats / 2))
+                    badIndex[i] = 1;
+                corners[cornerBase[i] + c] = corner;
+            }
+            std::vector<tinyobj::index_t>().swap(chunk.corners);    //Free as we go, big files hold a lot here
+        }
+    });
+    if (std::find(badIndex.begin(), badIndex.end(), 1) != badIndex.end()) {
+        error = path + ": face index out of range";
+        return false;
+    }
+
+    //Split quads along the shorter diagonal like tinyobj does
+    parallelFor(chunkCount, 1, [&](int first, int last) {
+        for (int i = first; i < last; i++)
+            for (size_t q = 0; q < chunks[i].quads.size(); q++) {
+                tinyobj::index_t* quad = &corners[cornerBase[i] + chunks[i].quads[q]];
+                tinyobj::index_t c0 = quad[0], c1 = quad[1], c2 = quad[2], c3 = quad[5];
+                const tinyobj::real_t* p0 = &attributes.vertices[c0.vertex_index * 3];
+                const tinyobj::real_t* p1 = &attributes.vertices[c1.vertex_index * 3];
+                const tinyobj::real_t* p2 = &attributes.vertices[c2.vertex_index * 3];
+                const tinyobj::real_t* p3 = &attributes.vertices[c3.vertex_index * 3];
+                tinyobj::real_t sqr02 = 0, sqr13 = 0;
+                for (int k = 0; k < 3; k++) {
+                    sqr02 += (p2[k] - p0[k]) * (p2[k] - p0[k]);
+                    sqr13 += (p3[k] - p1[k]) * (p3[k] - p1[k]);
+                }
+                if (sqr02 >= sqr13) {
+                    //[0, 1, 3], [1, 2, 3]
+                    quad[2] = c3;
+                    quad[3] = c1;
+                    quad[4] = c2;
+                    quad[5] = c3;
+                }
+            }
+    });
+
+    //Split into shapes at o/g lines, starting a new shape only once the current one has faces
+    std::string name;
+    size_t shapeStart = 0;
+    for (int i = 0; i <= chunkCount; i++) {
+        size_t breakCount = i < chunkCount ? chunks[i].breaks.size() : 1;
+        for (size_t b = 0; b < breakCount; b++) {
+            size_t at = i < chunkCount ? cornerBase[i] + chunks[i].breaks[b].corner : cornerTotal;
+            if (at > shapeStart) {
+                shapes.push_back(tinyobj::shape_t());
+                shapes.back().name = name;
+                shapes.back().mesh.indices.assign(corners.begin() + shapeStart, corners.begin() + at);
+                shapeStart = at;
+            }
+            if (i < chunkCount)
+                name = chunks[i].breaks[b].name;
+        }
+    }
+    for (size_t s = 0; s < shapes.size(); s++) {
+        size_t triangles = shapes[s].mesh.indices.size() / 3;
+        shapes[s].mesh.num_face_vertices.assign(triangles, 3);
+        shapes[s].mesh.material_ids.assign(triangles, -1);
+        shapes[s].mesh.smoothing_group_ids.assign(triangles, 0);
+    }
+    return true;
+}
+
+#endif
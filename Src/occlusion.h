@@ -0,0 +1,241 @@
+#ifndef OCCLUSION_FILE
+#define OCCLUSION_FILE
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "parallel.h"
+#include "simd.h"
+
+#define OCCLUSION_WIDTH 320         //Depth buffer resolution. Rounded up to whole tiles
+#define OCCLUSION_HEIGHT 192
+#define OCCLUSION_TILE 8            //Tile edge in pixels. Each tile keeps its farthest depth for the coarse test
+#define OCCLUSION_MIN_W 1e-5f       //Clip w below this is at or behind the eye
+#define OCCLUSION_TILE_ROWS_PER_THREAD 2
+#define OCCLUSION_MAX_OCCLUDERS 16  //Nearest objects rasterized as occluders each frame
+
+//Occluder triangle after projection, in buffer pixels. Depth is NDC z remapped to 0 (near) - 1 (far),
+//which is linear in screen space for both projections
+struct OccluderTriangle {
+    float x[3], y[3], z[3];
+    int minX, minY, maxX, maxY;     //Pixel bounds, inclusive
+};
+
+//Low resolution depth buffer rasterized on the CPU from a few large occluders, then used to reject
+//bounding boxes hidden behind them before they are drawn. Rows of tiles rasterize on separate threads
+//and 4 pixels are shaded per SSE step, with the depth write masked to the covered pixels.
+//Boxes are tested against each tile's farthest depth first and only look at pixels where that isn't enough.
+//Pure CPU, no GL state
+class OcclusionBuffer {
+public:
+    int width = 0, height = 0;
+    int tilesX = 0, tilesY = 0;
+    int occluderTriangles = 0;      //Triangles rasterized by the last rasterize()
+    int tested = 0, occluded = 0;   //Boxes tested since clear() and how many were hidden
+
+    // @param w - Width in pixels
+    // @param h - Height in pixels
+    void resize(int w, int h) {
+        tilesX = (std::max(w, 1) + OCCLUSION_TILE - 1) / OCCLUSION_TILE;
+        tilesY = (std::max(h, 1) + OCCLUSION_TILE - 1) / OCCLUSION_TILE;
+        width = tilesX * OCCLUSION_TILE;
+        height = tilesY * OCCLUSION_TILE;
+        depth.assign((size_t)width * height, 1.f);
+        tileMax.assign((size_t)tilesX * tilesY, 1.f);
+    }
+
+    //Starts a frame: empties the buffer and the occluder list
+    // @param viewProjection - projection * view of the camera being drawn
+    void clear(const glm::mat4& viewProjection) {
+        if (width == 0)
+            resize(OCCLUSION_WIDTH, OCCLUSION_HEIGHT);
+        this->viewProjection = viewProjection;
+        std::fill(depth.begin(), depth.end(), 1.f);
+        std::fill(tileMax.begin(), tileMax.end(), 1.f);
+        triangles.clear();
+        occluderTriangles = tested = occluded = 0;
+    }
+
+    //Projects an indexed mesh and queues its triangles. Triangles reaching past the near plane are
+    //dropped rather than clipped, which only ever makes the occluder smaller
+    // @param vertices - Positions at the start of each vertex
+    // @param stride - Floats per vertex
+    // @param indices - 3 per triangle
+    // @param transform - Model matrix
+    void addOccluder(const float* vertices, int stride, const unsigned int* indices, int indexCount, const glm::mat4& transform) {
+        glm::mat4 toClip = viewProjection * transform;
+        for (int t = 0; t + 2 < indexCount; t += 3) {
+            OccluderTriangle triangle;
+            bool usable = true;
+            for (int c = 0; c < 3 && usable; c++) {
+                const float* v = &vertices[(size_t)indices[t + c] * stride];
+                glm::vec4 clip = toClip * glm::vec4(v[0], v[1], v[2], 1.f);
+                usable = clip.w > OCCLUSION_MIN_W && clip.z >= -clip.w;
+                if (!usable)
+                    break;
+                float inverseW = 1.f / clip.w;
+                triangle.x[c] = (clip.x * inverseW * 0.5f + 0.5f) * width;
+                triangle.y[c] = (clip.y * inverseW * 0.5f + 0.5f) * height;
+                triangle.z[c] = clip.z * inverseW * 0.5f + 0.5f;
+            }
+            if (!usable)
+                continue;
+
+            //Pixels whose centers can fall inside
+            triangle.minX = std::max((int)std::ceil(std::min(triangle.x[0], std::min(triangle.x[1], triangle.x[2])) - 0.5f), 0);
+            triangle.minY = std::max((int)std::ceil(std::min(triangle.y[0], std::min(triangle.y[1], triangle.y[2])) - 0.5f), 0);
+            triangle.maxX = std::min((int)std::floor(std::max(triangle.x[0], std::max(triangle.x[1], triangle.x[2])) - 0.5f), width - 1);
+            triangle.maxY = std::min((int)std::floor(std::max(triangle.y[0], std::max(triangle.y[1], triangle.y[2])) - 0.5f), height - 1);
+            if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+                continue;   //Off screen or between pixel centers
+            triangles.push_back(triangle);
+        }
+    }
+
+    //Rasterizes every queued occluder and builds the tile depths
+    void rasterize() {
+        occluderTriangles = (int)triangles.size();
+        parallelFor(tilesY, OCCLUSION_TILE_ROWS_PER_THREAD, [this](int begin, int end) {
+            for (int tileY = begin; tileY < end; tileY++) {
+                int rowBegin = tileY * OCCLUSION_TILE, rowEnd = rowBegin + OCCLUSION_TILE;
+                for (size_t t = 0; t < triangles.size(); t++)
+                    rasterizeTriangle(triangles[t], rowBegin, rowEnd);
+                for (int tileX = 0; tileX < tilesX; tileX++)
+                    tileMax[(size_t)tileY * tilesX + tileX] = farthestInTile(tileX, tileY);
+            }
+        });
+    }
+
+    //Whether any part of a world space box may be in front of the occluders
+    // @returns False only when the box is certainly hidden
+    bool testBox(const glm::vec3& boxMin, const glm::vec3& boxMax) {
+        tested++;
+        float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, nearest = 1e30f;
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 p((corner & 1) ? boxMax.x : boxMin.x, (corner & 2) ? boxMax.y : boxMin.y, (corner & 4) ? boxMax.z : boxMin.z);
+            glm::vec4 clip = viewProjection * glm::vec4(p, 1.f);
+            if (clip.w <= OCCLUSION_MIN_W)
+                return true;    //Reaches behind the eye
+            float inverseW = 1.f / clip.w;
+            float x = (clip.x * inverseW * 0.5f + 0.5f) * width;
+            float y = (clip.y * inverseW * 0.5f + 0.5f) * height;
+            minX = std::min(minX, x); maxX = std::max(maxX, x);
+            minY = std::min(minY, y); maxY = std::max(maxY, y);
+            nearest = std::min(nearest, clip.z * inverseW * 0.5f + 0.5f);
+        }
+        if (nearest <= 0.f)
+            return true;        //Crosses the near plane
+
+        int x0 = std::max((int)std::floor(minX), 0), x1 = std::min((int)std::floor(maxX), width - 1);
+        int y0 = std::max((int)std::floor(minY), 0), y1 = std::min((int)std::floor(maxY), height - 1);
+        if (x0 > x1 || y0 > y1)
+            return true;        //Off screen, frustum culling's call
+
+        for (int tileY = y0 / OCCLUSION_TILE; tileY <= y1 / OCCLUSION_TILE; tileY++)
+            for (int tileX = x0 / OCCLUSION_TILE; tileX <= x1 / OCCLUSION_TILE; tileX++) {
+                if (tileMax[(size_t)tileY * tilesX + tileX] < nearest)
+                    continue;   //Whole tile is in front of the box
+                //Coarse test failed, check the covered pixels of this tile
+                int px0 = std::max(x0, tileX * OCCLUSION_TILE), px1 = std::min(x1, tileX * OCCLUSION_TILE + OCCLUSION_TILE - 1);
+                int py0 = std::max(y0, tileY * OCCLUSION_TILE), py1 = std::min(y1, tileY * OCCLUSION_TILE + OCCLUSION_TILE - 1);
+                for (int y = py0; y <= py1; y++)
+                    for (int x = px0; x <= px1; x++)
+                        if (depth[(size_t)y * width + x] >= nearest)
+                            return true;
+            }
+        occluded++;
+        return false;
+    }
+
+    bool testSphere(const glm::vec3& center, float radius) {
+        return testBox(center - glm::vec3(radius), center + glm::vec3(radius));
+    }
+
+    //Depth at a pixel, 0 near to 1 far. Row 0 is the bottom of the screen
+    float depthAt(int x, int y) const {
+        return depth[(size_t)y * width + x];
+    }
+
+private:
+    glm::mat4 viewProjection = glm::mat4(1.f);
+    std::vector<float> depth;           //Row major, width * height
+    std::vector<float> tileMax;         //Farthest depth in each tile
+    std::vector<OccluderTriangle> triangles;
+
+    //Keeps the nearest depth at every covered pixel center in rows [rowBegin, rowEnd)
+    void rasterizeTriangle(const OccluderTriangle& tri, int rowBegin, int rowEnd) {
+        int y0 = std::max(tri.minY, rowBegin), y1 = std::min(tri.maxY, rowEnd - 1);
+        if (y0 > y1)
+            return;
+
+        //Edge functions e(x, y) = a * x + b * y + c, one per edge, positive inside
+        float a[3], b[3], c[3];
+        for (int e = 0; e < 3; e++) {
+            int from = (e + 1) % 3, to = (e + 2) % 3;   //Edge opposite vertex e
+            a[e] = tri.y[from] - tri.y[to];
+            b[e] = tri.x[to] - tri.x[from];
+            c[e] = tri.x[from] * tri.y[to] - tri.x[to] * tri.y[from];
+        }
+        float area = a[0] * tri.x[0] + b[0] * tri.y[0] + c[0];    //Twice the signed area
+        if (std::fabs(area) < 1e-8f)
+            return;
+        float sign = area > 0.f ? 1.f : -1.f;   //Either winding, occluders may be seen from inside
+        for (int e = 0; e < 3; e++) {
+            a[e] *= sign; b[e] *= sign; c[e] *= sign;
+        }
+        area *= sign;
+
+        //Depth plane from the barycentric weights
+        float inverseArea = 1.f / area;
+        float za = (a[0] * tri.z[0] + a[1] * tri.z[1] + a[2] * tri.z[2]) * inverseArea;
+        float zb = (b[0] * tri.z[0] + b[1] * tri.z[1] + b[2] * tri.z[2]) * inverseArea;
+        float zc = (c[0] * tri.z[0] + c[1] * tri.z[1] + c[2] * tri.z[2]) * inverseArea;
+
+        int x0 = tri.minX & ~3;     //Width is a multiple of 4 so whole groups stay in the row
+        for (int y = y0; y <= y1; y++) {
+            float py = y + 0.5f;
+            float* row = &depth[(size_t)y * width];
+            int x = x0;
+#if USE_SSE
+            __m128 offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+            __m128 e0Row = _mm_set1_ps(b[0] * py + c[0]), e1Row = _mm_set1_ps(b[1] * py + c[1]), e2Row = _mm_set1_ps(b[2] * py + c[2]);
+            __m128 zRow = _mm_set1_ps(zb * py + zc);
+            __m128 a0 = _mm_set1_ps(a[0]), a1 = _mm_set1_ps(a[1]), a2 = _mm_set1_ps(a[2]), zx = _mm_set1_ps(za);
+            __m128 zero = _mm_setzero_ps();
+            for (; x <= tri.maxX; x += 4) {
+                __m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+                __m128 inside = _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), e0Row), zero),
+                    _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), e1Row), zero),
+                        _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), e2Row), zero)));
+                if (_mm_movemask_ps(inside) == 0)
+                    continue;
+                __m128 z = _mm_add_ps(_mm_mul_ps(zx, px), zRow);
+                __m128 old = _mm_loadu_ps(row + x);
+                __m128 nearer = _mm_min_ps(old, z);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+            }
+#endif
+            for (; x <= tri.maxX; x++) {
+                float px = x + 0.5f;
+                if (a[0] * px + b[0] * py + c[0] < 0.f || a[1] * px + b[1] * py + c[1] < 0.f || a[2] * px + b[2] * py + c[2] < 0.f)
+                    continue;
+                float z = za * px + zb * py + zc;
+                if (z < row[x])
+                    row[x] = z;
+            }
+        }
+    }
+
+    float farthestInTile(int tileX, int tileY) const {
+        float farthest = 0.f;
+        for (int y = 0; y < OCCLUSION_TILE; y++) {
+            const float* row = &depth[(size_t)(tileY * OCCLUSION_TILE + y) * width + tileX * OCCLUSION_TILE];
+            for (int x = 0; x < OCCLUSION_TILE; x++)
+                farthest = std::max(farthest, row[x]);
+        }
+        return farthest;
+    }
+};
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef PARALLEL_FILE
+#define PARALLEL_FILE
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <algorithm>
+
+//Number of threads available for splitting work
+inline int workerCount() {
+    unsigned int count = std::thread::hardware_concurrency();
+    return count > 0 ? (int)count : 1;  //hardware_concurrency() can return 0 when unknown
+}
+
+//True on threads that belong to a worker pool (this file's or the asset pipeline's).
+//parallelFor runs inline on them rather than queueing behind the pool it is part of
+inline bool& onWorkerThread() {
+    static thread_local bool worker = false;
+    return worker;
+}
+
+//True while the calling thread runs ranges of its own WorkerPool::run. A nested parallelFor runs
+//inline then, the pool is already busy with the outer job
+inline bool& insidePoolJob() {
+    static thread_local bool inside = false;
+    return inside;
+}
+
+//Threads started once and kept waiting for ranges, so splitting work costs a wake up instead of a thread start
+class WorkerPool {
+public:
+    // @param threads - Workers besides the calling thread
+    explicit WorkerPool(int threads) {
+        for (int i = 0; i < threads; i++)
+            workers.push_back(std::thread(&WorkerPool::workerLoop, this));
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    int size() const { return (int)workers.size(); }
+
+    //Calls task(context, range) for every range in [0, ranges) on the workers and the calling thread.
+    //Returns once all of them are done
+    //Must not be called from inside a pool job, parallelFor checks insidePoolJob() first
+    // @returns False without running anything when another thread is using the pool
+    bool run(int ranges, void (*task)(void*, int), void* context) {
+        std::unique_lock<std::mutex> busy(submitLock, std::try_to_lock);
+        if (!busy.owns_lock())
+            return false;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            jobTask = task;
+            jobContext = context;
+            jobRanges = ranges;
+            nextRange = 0;
+            pending = ranges;
+        }
+        wake.notify_all();
+        insidePoolJob() = true;
+        runRanges();    //Calling thread takes ranges too
+        insidePoolJob() = false;
+
+        std::unique_lock<std::mutex> guard(lock);
+        done.wait(guard, [this] { return pending == 0; });
+        return true;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex lock, submitLock;
+    std::condition_variable wake, done;
+    void (*jobTask)(void*, int) = NULL;
+    void* jobContext = NULL;
+    int jobRanges = 0, nextRange = 0, pending = 0;
+    bool stopping = false;
+
+    //Takes ranges of the current job until none are left
+    void runRanges() {
+        for (;;) {
+            void (*task)(void*, int);
+            void* context;
+            int range;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if (nextRange >= jobRanges)
+                    return;
+                range = nextRange++;
+                task = jobTask;
+                context = jobContext;
+            }
+            task(context, range);
+            bool last;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                last = --pending == 0;
+            }
+            if (last)
+                done.notify_all();
+        }
+    }
+
+    void workerLoop() {
+        onWorkerThread() = true;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wake.wait(guard, [this] { return stopping || nextRange < jobRanges; });
+                if (stopping)
+                    return;
+            }
+            runRanges();
+        }
+    }
+};
+
+//The pool shared by every parallelFor, started on first use
+inline WorkerPool& workerPool() {
+    static WorkerPool pool(workerCount() - 1);
+    return pool;
+}
+
+//Splits [0, count) into contiguous ranges and runs them on the worker pool and the calling thread
+// @param count - Total number of items
+// @param minPerThread - Smallest range worth a thread. Small jobs run on the calling thread
+// @param func - Called as func(begin, end) for every range
+template <typename Func>
+void parallelFor(int count, int minPerThread, Func func) {
+    if (count <= 0)
+        return;
+
+    int threads = std::min(workerCount(), (count + minPerThread - 1) / minPerThread);
+    if (threads <= 1 || onWorkerThread() || insidePoolJob()) {
+        func(0, count);     //Not worth waking the pool, or already running on it
+        return;
+    }
+
+    struct Ranges {
+        Func* func;
+        int count, chunk;
+
+        static void run(void* self, int range) {
+            Ranges* ranges = (Ranges*)self;
+            int begin = range * ranges->chunk;
+            int end = std::min(ranges->count, begin + ranges->chunk);
+            if (begin < end)
+                (*ranges->func)(begin, end);
+        }
+    };
+    Ranges ranges = { &func, count, (count + threads - 1) / threads };
+    if (!workerPool().run(threads, &Ranges::run, &ranges))
+        func(0, count);     //Another thread has the pool
+}
+
+#endif
@@ -18,6 +18,8 @@
 #define BASIC_SPRING 1
 #define ANCHORED_SPRING 2
 #define ELASTIC_BUNGEE 3
+#define FLUID 5
+#define SOFT_BODY 6
 
 #define PROJECTILE_TYPES 8
 
@@ -30,14 +32,30 @@
 #define MAX_PARTICLES 8
 #define MAX_SPRINGS 2
 
+#define SPRING_RENDER_SCALE 1.f     //Planet mesh scale for each spring end
+#define CONTACT_RESTITUTION 0.5f    //Bounce kept when two particles collide (0 - Stop, 1 - Elastic)
+#define LASER_RANGE 500.f           //Max distance of a laser hitscan
+#define REORDER_INTERVAL 60         //Physics steps between Morton reorders of particle storage
+
+#define FLUID_SIDE 8                //Fluid spawns as a FLUID_SIDE^3 block
+#define FLUID_PARTICLES (FLUID_SIDE * FLUID_SIDE * FLUID_SIDE)
+#define FLUID_SPACING 0.5f          //Gap between fluid particles at rest. Rest density = mass / spacing^3
+#define FLUID_RENDER_SCALE 0.25f    //Planet mesh is shrunk to this for each fluid particle
+static glm::vec3 fluidBoundsMin = glm::vec3(-5.f, -5.f, -15.f);   //Container the fluid sloshes in
+static glm::vec3 fluidBoundsMax = glm::vec3(5.f, 5.f, -5.f);
+
+#define SOFTBODY_SCALE 3.f          //Soft body mesh is scaled up by this
+#define SOFTBODY_STIFFNESS 20.f     //Spring constant of every lattice link
+static glm::vec3 softBodyCenter = glm::vec3(0.f, 0.f, -10.f);
+
 //Preset values for damp, v, a
                             //BASIC//ANCHORED//BUNGEE
-static float dampSettings[] = { 0.99f , 0.99f, 0.9f, 0.99f };   //Replaced by DragForce
-static float massSettings[] = { 1.f , 1.f, 1.f, 0.1f };     //Mass will affect spring force
+static float dampSettings[] = { 0.99f , 0.99f, 0.9f, 0.99f, 1.f, 1.f };   //Replaced by DragForce
+static float massSettings[] = { 1.f , 1.f, 1.f, 0.1f, 1.f, 1.f };     //Mass will affect spring force
 
-static float gravitySettings[] = { INACTIVE , ACTIVE, INACTIVE, INACTIVE };   //Activate gravity for springs
-static float constantForceSettings[] = { ACTIVE , ACTIVE, ACTIVE, ACTIVE };   //Allow user to apply force per click
-static float dragForceSettings[] = { ACTIVE , ACTIVE, ACTIVE, ACTIVE };       //Activate drag for all springs   
+static float gravitySettings[] = { INACTIVE , ACTIVE, INACTIVE, INACTIVE, ACTIVE, INACTIVE };   //Activate gravity for springs
+static float constantForceSettings[] = { ACTIVE , ACTIVE, ACTIVE, ACTIVE, INACTIVE, ACTIVE };   //Allow user to apply force per click
+static float dragForceSettings[] = { ACTIVE , ACTIVE, ACTIVE, ACTIVE, INACTIVE, ACTIVE };       //Activate drag for all springs (fluid uses SPH viscosity)
 
 static glm::vec3 ORIGIN = glm::vec3(0.f, 0.f, 0.f);
 static glm::vec3 velocitySettings[] = {
@@ -45,19 +63,24 @@ static glm::vec3 velocitySettings[] = {
     glm::vec3(0.f, 0.1f, 0.f),  //1 Basic Spring
     glm::vec3(0.1f, 0.f, 0.f),  //2 Anchored Spring 
     glm::vec3(0.1f, 0.f, 0.f),  //3 Elastic Bungee
-    glm::vec3(100.f, 0.f, 0.f), //4 
+    glm::vec3(0.1f, 0.f, 0.f),  //4 Laser targets
+    glm::vec3(0.1f, 0.f, 0.f),  //5 Fluid
+    glm::vec3(0.1f, 0.f, 0.f),  //6 Soft body
 };
 static glm::vec3 accelerationSettings[] = { //Constant force. Partnered with ACTIVE/INACTIVE constantForceSettings[]
     glm::vec3(-10.f, 5.f, 0.f),     //1 BASIC: Glide right
     glm::vec3(100.f, 0.f, 0.f),     //2 ANCHORED: Move left
     glm::vec3(100.f, 0.f, 0.f),     //3 ELASTIC: Move left
     glm::vec3(0.f, 0.f, 0.f),       //4
+    glm::vec3(0.f, 0.f, 0.f),       //5
+    glm::vec3(0.f, 0.f, 300.f),     //6 SOFT BODY: Poke a vertex inwards
 };
 static glm::vec3 springsInitPos[][2] = {
     //Part1Pos          //Part2Pos
     {glm::vec3(SPRING_REST_LENGTH + 3.f, 0.f, 0.f), glm::vec3(SPRING_REST_LENGTH, 0.f, 0.f)},
     {ORIGIN, glm::vec3(0.f, -SPRING_REST_LENGTH, 0.f)},
-    {glm::vec3(-3.f, 1.f, 0.f), ORIGIN}
+    {glm::vec3(-3.f, 1.f, 0.f), ORIGIN},
+    {glm::vec3(-3.f, 0.f, -10.f), glm::vec3(3.f, 0.f, -10.f)}    //Laser targets
 };
 
 
@@ -0,0 +1,231 @@
+#ifndef RENDER_QUEUE_FILE
+#define RENDER_QUEUE_FILE
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include "meshcache.h"
+#include "instancebuffer.h"
+#include "sprites.h"
+#include "glstate.h"
+
+//Sort key layout, most significant first: pass | shader | material | depth
+#define SORT_PASS_BITS 4
+#define SORT_SHADER_BITS 8
+#define SORT_MATERIAL_BITS 20
+#define SORT_DEPTH_BITS 32
+#define SORT_DEPTH_SHIFT 0
+#define SORT_MATERIAL_SHIFT (SORT_DEPTH_SHIFT + SORT_DEPTH_BITS)
+#define SORT_SHADER_SHIFT (SORT_MATERIAL_SHIFT + SORT_MATERIAL_BITS)
+#define SORT_PASS_SHIFT (SORT_SHADER_SHIFT + SORT_SHADER_BITS)
+
+//Passes run in this order
+enum RenderPass {
+    RENDER_PASS_OPAQUE,     //Front to back, no blending
+    RENDER_PASS_BLENDED     //Back to front, alpha blended, no depth writes
+};
+
+//Textures and shading switches shared by every draw that uses them
+struct Material {
+    GLuint texBase, texNorm, texOverlay;
+    int blendMode;          //(0-No overlay), (1-Overlay), (2-Multiply)
+    int lightingMode;       //(-1 Spotlight, 0 Unlit, 1 Point light)
+};
+
+//What to draw once the state from the key is set
+struct DrawCommand {
+    enum Kind { MESH, INSTANCED, ARRAY, SPRITES };   //ARRAY draws a bare VAO
+    Kind kind;
+    const Mesh* mesh;
+    const InstanceBuffer* instances;
+    const SpriteBatch* sprites;
+    GLuint VAO;
+    GLsizei indexCount;
+    int lod;
+    glm::mat4 transform;    //Unused by instanced draws
+};
+
+struct RenderItem {
+    uint64_t key;
+    uint32_t command;       //Index into the queue's commands
+};
+
+//Distance in front of the camera, for the depth part of a key
+inline float viewDepth(const glm::mat4& view, const glm::vec3& position) {
+    float depth = -(view * glm::vec4(position, 1.f)).z;
+    return depth > 0.f ? depth : 0.f;
+}
+
+//Builds a sort key. Opaque draws go front to back so early depth testing rejects more,
+//blended ones back to front so they composite correctly
+// @param depth - View depth from viewDepth
+inline uint64_t makeSortKey(RenderPass pass, int shader, int material, float depth) {
+    uint32_t depthBits;
+    std::memcpy(&depthBits, &depth, sizeof(depthBits));   //Non negative floats order like their bits
+    if (pass == RENDER_PASS_BLENDED)
+        depthBits = ~depthBits;
+    return ((uint64_t)pass << SORT_PASS_SHIFT)
+        | ((uint64_t)(shader & ((1 << SORT_SHADER_BITS) - 1)) << SORT_SHADER_SHIFT)
+        | ((uint64_t)(material & ((1 << SORT_MATERIAL_BITS) - 1)) << SORT_MATERIAL_SHIFT)
+        | ((uint64_t)depthBits << SORT_DEPTH_SHIFT);
+}
+
+//Pulls one part back out of a key
+inline int sortKeyField(uint64_t key, int shift, int bits) {
+    return (int)((key >> shift) & ((1ull << bits) - 1));
+}
+
+//LSD radix sort on the 64 bit keys, a byte per pass. Bytes that are the same in every key
+//(common for the pass and shader bytes) are skipped. Stable, so equal keys keep submission order
+// @param items - Sorted in place
+// @param scratch - Reused buffer
+inline void radixSortKeys(std::vector<RenderItem>& items, std::vector<RenderItem>& scratch) {
+    size_t count = items.size();
+    if (count < 2)
+        return;
+    scratch.resize(count);
+    RenderItem* from = items.data();
+    RenderItem* to = scratch.data();
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t offsets[256] = { 0 };
+        for (size_t i = 0; i < count; i++)
+            offsets[(from[i].key >> shift) & 0xFF]++;
+        if (offsets[(from[0].key >> shift) & 0xFF] == count)
+            continue;   //Every key has this byte, nothing moves
+
+        size_t sum = 0;
+        for (int b = 0; b < 256; b++) {
+            size_t bucket = offsets[b];
+            offsets[b] = sum;
+            sum += bucket;
+        }
+        for (size_t i = 0; i < count; i++)
+            to[offsets[(from[i].key >> shift) & 0xFF]++] = from[i];
+        RenderItem* swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != items.data())
+        std::memcpy(items.data(), from, sizeof(RenderItem) * count);
+}
+
+//Draws submitted during a frame, sorted once and executed with a state change only where the
+//pass, shader or material part of the key differs from the previous draw
+class RenderQueue {
+public:
+    std::vector<Material> materials;        //Kept across frames so ids stay stable
+    int shaderChanges = 0, materialChanges = 0, draws = 0;  //Last execute
+
+    //Id of a material, added the first time it is seen
+    int materialId(const Material& material) {
+        for (size_t i = 0; i < materials.size(); i++)
+            if (std::memcmp(&materials[i], &material, sizeof(Material)) == 0)
+                return (int)i;
+        materials.push_back(material);
+        return (int)materials.size() - 1;
+    }
+
+    // @param depth - View depth, orders draws inside the same pass, shader and material
+    void submitMesh(RenderPass pass, int shader, int material, float depth, const Mesh* mesh, const glm::mat4& transform, int lod = 0) {
+        DrawCommand command = { DrawCommand::MESH, mesh, NULL, NULL, 0, 0, lod, transform };
+        push(makeSortKey(pass, shader, material, depth), command);
+    }
+
+    void submitInstanced(RenderPass pass, int shader, int material, const Mesh* mesh, const InstanceBuffer* instances) {
+        DrawCommand command = { DrawCommand::INSTANCED, mesh, instances, NULL, 0, 0, 0, glm::mat4(1.f) };
+        push(makeSortKey(pass, shader, material, 0.f), command);
+    }
+
+    //Sprites sort themselves back to front when blended, so they take no depth
+    void submitSprites(RenderPass pass, int shader, int material, const SpriteBatch* sprites) {
+        DrawCommand command = { DrawCommand::SPRITES, NULL, NULL, sprites, 0, 0, 0, glm::mat4(1.f) };
+        push(makeSortKey(pass, shader, material, 0.f), command);
+    }
+
+    void submitVAO(RenderPass pass, int shader, int material, float depth, GLuint VAO, GLsizei indexCount, const glm::mat4& transform) {
+        DrawCommand command = { DrawCommand::ARRAY, NULL, NULL, NULL, VAO, indexCount, 0, transform };
+        push(makeSortKey(pass, shader, material, depth), command);
+    }
+
+    //Sorts and issues every submitted draw, then empties the queue
+    // @param shaders - Programs indexed by the shader part of the key
+    template <typename ShaderT>
+    void execute(ShaderT* const* shaders) {
+        radixSortKeys(items, scratch);
+        shaderChanges = materialChanges = draws = 0;
+
+        int pass = -1, shader = -1, material = -1;
+        for (size_t i = 0; i < items.size(); i++) {
+            uint64_t key = items[i].key;
+            int itemPass = sortKeyField(key, SORT_PASS_SHIFT, SORT_PASS_BITS);
+            int itemShader = sortKeyField(key, SORT_SHADER_SHIFT, SORT_SHADER_BITS);
+            int itemMaterial = sortKeyField(key, SORT_MATERIAL_SHIFT, SORT_MATERIAL_BITS);
+
+            if (itemPass != pass) {
+                bool blend = itemPass == RENDER_PASS_BLENDED;
+                if (blend) {
+                    glState().enable(GL_BLEND);
+                    glState().blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                }
+                else
+                    glState().disable(GL_BLEND);
+                glState().depthMask(blend ? GL_FALSE : GL_TRUE);    //Translucent draws test depth but don't hide what's behind
+                pass = itemPass;
+            }
+            ShaderT* program = shaders[itemShader];
+            if (itemShader != shader) {
+                program->use();
+                shader = itemShader;
+                material = -1;      //Textures are set through the new program's uniforms
+                shaderChanges++;
+            }
+            if (itemMaterial != material) {
+                const Material& m = materials[itemMaterial];
+                program->passTextures(m.texBase, m.texNorm, m.texOverlay, m.blendMode);
+                program->passLightingMode(m.lightingMode);
+                material = itemMaterial;
+                materialChanges++;
+            }
+
+            const DrawCommand& command = commands[items[i].command];
+            switch (command.kind) {
+            case DrawCommand::MESH:
+                program->passTransform(command.transform);
+                program->draw(command.mesh, command.lod);
+                break;
+            case DrawCommand::INSTANCED:
+                program->drawInstanced(command.mesh, *command.instances);
+                break;
+            case DrawCommand::SPRITES:
+                program->drawSprites(*command.sprites);
+                break;
+            case DrawCommand::ARRAY:
+                program->passTransform(command.transform);
+                program->draw(command.VAO, command.indexCount);
+                break;
+            }
+            draws++;
+        }
+        if (pass == RENDER_PASS_BLENDED) {
+            glState().disable(GL_BLEND);
+            glState().depthMask(GL_TRUE);
+        }
+
+        items.clear();
+        commands.clear();
+    }
+
+private:
+    std::vector<RenderItem> items, scratch;
+    std::vector<DrawCommand> commands;
+
+    void push(uint64_t key, const DrawCommand& command) {
+        RenderItem item = { key, (uint32_t)commands.size() };
+        items.push_back(item);
+        commands.push_back(command);
+    }
+};
+
+#endif
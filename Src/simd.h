@@ -0,0 +1,21 @@
+#ifndef SIMD_FILE
+#define SIMD_FILE
+
+//SSE2 is always there on x64 and is MSVC's default for x86. Other targets use the scalar paths
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE 1
+#include <emmintrin.h>
+
+//Adds the 4 lanes together
+inline float horizontalSum(__m128 v) {
+    __m128 shuffled = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(v, shuffled);
+    shuffled = _mm_movehl_ps(shuffled, sums);
+    sums = _mm_add_ss(sums, shuffled);
+    return _mm_cvtss_f32(sums);
+}
+#else
+#define USE_SSE 0
+#endif
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef SOFT_BODY_FILE
+#define SOFT_BODY_FILE
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include "meshcache.h"
+#include "framering.h"
+#include "glstate.h"
+
+//Spring between two lattice points
+struct SpringLink {
+    int a, b;
+    float restLength;
+    float k;
+};
+
+//Particles and springs generated from a triangle mesh
+struct SoftBodyLattice {
+    std::vector<glm::vec3> points;      //One per unique mesh position (+ a center point with volume links)
+    std::vector<int> vertexToPoint;     //Lattice point for every render vertex
+    std::vector<SpringLink> links;
+    int structuralLinks = 0, bendingLinks = 0, volumeLinks = 0;
+    int centerPoint = -1;               //Core point when volume links are on
+};
+
+//Builds a mass-spring lattice out of an indexed triangle mesh
+// @param vertices - Interleaved vertices (as built by parseObj)
+// @param vertexCount - Number of vertices
+// @param indices - 3 vertex indices per triangle
+// @param indexCount - Number of indices
+// @param scale - Multiplies the mesh positions
+// @param offset - Added to the scaled positions
+// @param k - Spring constant for every link
+// @param bending - Link the far corners of every pair of triangles sharing an edge (resists folding)
+// @param volume - Link every point to a center point (resists collapsing)
+inline void buildLattice(const GLfloat* vertices, int vertexCount, const GLuint* indices, size_t indexCount, float scale, glm::vec3 offset, float k,
+    bool bending, bool volume, SoftBodyLattice& out) {
+    out = SoftBodyLattice();
+
+    //Weld corners sharing a position. UV seams split render vertices but not particles
+    struct PosHash {
+        size_t operator()(const glm::vec3& p) const {
+            uint32_t bits[3];
+            std::memcpy(bits, &p[0], sizeof(bits));
+            return (size_t)(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+        }
+    };
+    std::unordered_map<glm::vec3, int, PosHash> welded;
+    out.vertexToPoint.resize(vertexCount);
+    for (int v = 0; v < vertexCount; v++) {
+        glm::vec3 pos(vertices[v * MESH_STRIDE], vertices[v * MESH_STRIDE + 1], vertices[v * MESH_STRIDE + 2]);
+        std::unordered_map<glm::vec3, int, PosHash>::iterator found = welded.find(pos);
+        if (found == welded.end()) {
+            found = welded.insert(std::make_pair(pos, (int)out.points.size())).first;
+            out.points.push_back(pos * scale + offset);
+        }
+        out.vertexToPoint[v] = found->second;
+    }
+
+    //Unique edges, remembering the corner opposite each edge
+    struct EdgeInfo {
+        int opposite[2];
+        int faces;
+    };
+    std::unordered_map<uint64_t, EdgeInfo> edges;
+    std::vector<uint64_t> edgeOrder;    //Keeps the link order stable between runs
+    for (size_t t = 0; t + 2 < indexCount; t += 3) {
+        int corner[3] = { out.vertexToPoint[indices[t]], out.vertexToPoint[indices[t + 1]], out.vertexToPoint[indices[t + 2]] };
+        for (int e = 0; e < 3; e++) {
+            int a = corner[e], b = corner[(e + 1) % 3];
+            if (a == b)
+                continue;   //Degenerate triangle
+            uint64_t key = ((uint64_t)std::min(a, b) << 32) | (uint32_t)std::max(a, b);
+            std::unordered_map<uint64_t, EdgeInfo>::iterator edge = edges.find(key);
+            if (edge == edges.end()) {
+                EdgeInfo info = { { corner[(e + 2) % 3], -1 }, 1 };
+                edges.insert(std::make_pair(key, info));
+                edgeOrder.push_back(key);
+            }
+            else {
+                if (edge->second.faces == 1)
+                    edge->second.opposite[1] = corner[(e + 2) % 3];
+                edge->second.faces++;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < edgeOrder.size(); i++) {
+        int a = (int)(edgeOrder[i] >> 32), b = (int)(edgeOrder[i] & 0xffffffff);
+        SpringLink link = { a, b, glm::length(out.points[a] - out.points[b]), k };
+        out.links.push_back(link);
+    }
+    out.structuralLinks = (int)out.links.size();
+
+    if (bending) {
+        std::vector<uint64_t> linked(edgeOrder.begin(), edgeOrder.end());
+        std::sort(linked.begin(), linked.end());
+        for (size_t i = 0; i < edgeOrder.size(); i++) {
+            const EdgeInfo& info = edges[edgeOrder[i]];
+            if (info.faces != 2)
+                continue;   //Open or non-manifold edge
+            int a = std::min(info.opposite[0], info.opposite[1]);
+            int b = std::max(info.opposite[0], info.opposite[1]);
+            uint64_t key = ((uint64_t)a << 32) | (uint32_t)b;
+            if (a == b || std::binary_search(linked.begin(), linked.end(), key))
+                continue;   //Already a structural link
+            SpringLink link = { a, b, glm::length(out.points[a] - out.points[b]), k };
+            out.links.push_back(link);
+            out.bendingLinks++;
+        }
+    }
+
+    if (volume && !out.points.empty()) {
+        glm::vec3 center(0.f);
+        int surfacePoints = (int)out.points.size();
+        for (int p = 0; p < surfacePoints; p++)
+            center += out.points[p];
+        center /= (float)surfacePoints;
+
+        out.centerPoint = surfacePoints;
+        out.points.push_back(center);
+        for (int p = 0; p < surfacePoints; p++) {
+            SpringLink link = { out.centerPoint, p, glm::length(out.points[p] - center), k };
+            out.links.push_back(link);
+            out.volumeLinks++;
+        }
+    }
+}
+
+//Render mesh driven by lattice points. Positions are written each frame into a FrameRingBuffer
+//and attribute 0 is pointed at them. The other attributes stay static.
+class SkinnedMesh {
+public:
+    GLuint VAO = 0, staticVBO = 0, EBO = 0;
+    int vertexCount = 0;
+    GLsizei indexCount = 0;
+    std::vector<int> vertexToPoint;
+
+    //Creates the buffers. Attribute 0 reads the position stream once upload() has run, 1-4 read the original vertex data
+    // @param vertices - Interleaved vertices, vertexCount of them
+    // @param indices - indexCount triangle indices
+    void generate(const GLfloat* vertices, int vertexCount, const GLuint* indices, GLsizei indexCount, const std::vector<int>& pointOfVertex) {
+        this->vertexCount = vertexCount;
+        this->indexCount = indexCount;
+        vertexToPoint = pointOfVertex;
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &staticVBO);
+        glGenBuffers(1, &EBO);
+        glState().bindVertexArray(VAO);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * (size_t)indexCount, indices, GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ARRAY_BUFFER, staticVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * (size_t)vertexCount * MESH_STRIDE, vertices, GL_STATIC_DRAW);
+        GLsizei stride = MESH_STRIDE * sizeof(GLfloat);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_TRUE, stride, (void*)(3 * sizeof(GLfloat)));      //Normals
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(GLfloat)));     //UV
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride, (void*)(8 * sizeof(GLfloat)));     //Tangents
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, stride, (void*)(11 * sizeof(GLfloat)));    //Bitangents
+
+        for (int i = 0; i <= 4; i++)
+            glEnableVertexAttribArray(i);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glState().bindVertexArray(0);
+    }
+
+    //Writes the lattice positions straight into this frame's part of the ring and points attribute 0 at them
+    // @param ring - Per frame buffer
+    // @param points - Current lattice point positions
+    void upload(FrameRingBuffer& ring, const std::vector<glm::vec3>& points) {
+        GLintptr offset;
+        size_t bytes = sizeof(glm::vec3) * (size_t)vertexCount;
+        glm::vec3* positions = (glm::vec3*)ring.allocate(bytes, offset);
+        for (int v = 0; v < vertexCount; v++)
+            positions[v] = points[vertexToPoint[v]];
+        ring.commit(offset, bytes);
+
+        glState().bindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, ring.buffer);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)offset);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glState().bindVertexArray(0);
+    }
+
+    void destroy() {
+        glState().deletedVertexArray(VAO);
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &staticVBO);
+        glDeleteBuffers(1, &EBO);
+    }
+};
+
+#endif
@@ -0,0 +1,381 @@
+#ifndef SPATIAL_QUERY_FILE
+#define SPATIAL_QUERY_FILE
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cmath>
+#include <cfloat>
+#include "parallel.h"
+
+#define QUERY_MAX_CELLS 64      //Max grid cells per axis
+#define QUERY_BATCH_MIN 64      //Queries per thread before a batch is split
+
+//Result of a ray query
+struct RayHit {
+    int index = -1;                 //Index of the particle hit. -1 when nothing was hit
+    float distance = FLT_MAX;       //Distance along the ray
+    glm::vec3 point = glm::vec3(0.f);
+};
+
+//Uniform grid over the live particles for raycasts, radius and k-nearest queries.
+//Rebuild with build() whenever the particles move, then query as often as needed.
+//Queries are read only so the batched versions can split them across threads.
+class SpatialQuery {
+public:
+    float cellSize = 1.f;
+    glm::vec3 gridMin = glm::vec3(0.f);
+    int dims[3] = { 0, 0, 0 };
+
+    //Live entries (compacted). ids[] maps back to the caller's particle index
+    std::vector<glm::vec3> centers;
+    std::vector<float> radii;
+    std::vector<int> ids;
+    std::vector<int> homeCell;      //Cell holding the entry's center
+
+    //Entries grouped by cell. Cell c owns cellEntries[cellStart[c] .. cellStart[c + 1]]
+    std::vector<int> cellStart;
+    std::vector<int> cellEntries;
+
+    //Builds the grid from the particles that are still active
+    // @param positions - Particle centers
+    // @param radius - Particle bounding radius (may differ per particle)
+    // @param isActive - Only nonzero entries are added. Pass NULL to add all
+    // @param count - Number of particles in the arrays
+    void build(const glm::vec3* positions, const float* radius, const int* isActive, int count) {
+        centers.clear();
+        radii.clear();
+        ids.clear();
+        for (int i = 0; i < count; i++) {
+            if (isActive && !isActive[i])
+                continue;
+            centers.push_back(positions[i]);
+            radii.push_back(radius[i]);
+            ids.push_back(i);
+        }
+
+        int entries = (int)ids.size();
+        if (entries == 0) {
+            dims[0] = dims[1] = dims[2] = 0;
+            cellStart.assign(1, 0);
+            cellEntries.clear();
+            return;
+        }
+
+        //Bounds of every sphere and the average size
+        glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+        float radiusSum = 0.f;
+        for (int e = 0; e < entries; e++) {
+            boundsMin = glm::min(boundsMin, centers[e] - radii[e]);
+            boundsMax = glm::max(boundsMax, centers[e] + radii[e]);
+            radiusSum += radii[e];
+        }
+        glm::vec3 extent = boundsMax - boundsMin;
+        float maxExtent = std::max(extent.x, std::max(extent.y, extent.z));
+
+        //Cells about the size of an average particle, but capped so the grid stays small
+        cellSize = std::max(2.f * radiusSum / entries, maxExtent / std::cbrt((float)entries));
+        cellSize = std::max(cellSize, maxExtent / QUERY_MAX_CELLS);
+        if (cellSize <= 0.f)
+            cellSize = 1.f;     //All particles are points at the same spot
+
+        gridMin = boundsMin;
+        for (int a = 0; a < 3; a++)
+            dims[a] = std::min(QUERY_MAX_CELLS, std::max(1, (int)std::ceil(extent[a] / cellSize)));
+
+        //Count how many entries overlap each cell, then prefix sum into offsets
+        int cells = dims[0] * dims[1] * dims[2];
+        cellStart.assign(cells + 1, 0);
+        homeCell.resize(entries);
+        for (int e = 0; e < entries; e++) {
+            int lo[3], hi[3];
+            sphereCells(centers[e], radii[e], lo, hi);
+            for (int z = lo[2]; z <= hi[2]; z++)
+                for (int y = lo[1]; y <= hi[1]; y++)
+                    for (int x = lo[0]; x <= hi[0]; x++)
+                        cellStart[cellIndex(x, y, z) + 1]++;
+
+            homeCell[e] = cellIndex(cellCoord(centers[e].x, 0), cellCoord(centers[e].y, 1), cellCoord(centers[e].z, 2));
+        }
+        for (int c = 0; c < cells; c++)
+            cellStart[c + 1] += cellStart[c];
+
+        //Fill the cells
+        std::vector<int> cursor(cellStart.begin(), cellStart.end() - 1);
+        cellEntries.resize(cellStart[cells]);
+        for (int e = 0; e < entries; e++) {
+            int lo[3], hi[3];
+            sphereCells(centers[e], radii[e], lo, hi);
+            for (int z = lo[2]; z <= hi[2]; z++)
+                for (int y = lo[1]; y <= hi[1]; y++)
+                    for (int x = lo[0]; x <= hi[0]; x++)
+                        cellEntries[cursor[cellIndex(x, y, z)]++] = e;
+        }
+    }
+
+    //Finds the first particle along a ray
+    // @param origin - Start of the ray
+    // @param dir - Direction of the ray (does not need to be normalized)
+    // @param maxDist - Ignore hits further than this
+    // @param hit - Receives the hit particle, distance and point
+    // @return True when something was hit
+    bool raycast(glm::vec3 origin, glm::vec3 dir, float maxDist, RayHit* hit) const {
+        hit->index = -1;
+        hit->distance = FLT_MAX;
+        if (ids.empty() || glm::dot(dir, dir) <= 0.f)
+            return false;
+        dir = glm::normalize(dir);
+
+        //Clip the ray against the grid bounds (slab test)
+        float tEnter = 0.f, tExit = maxDist;
+        for (int a = 0; a < 3; a++) {
+            float lo = gridMin[a];
+            float hi = gridMin[a] + dims[a] * cellSize;
+            if (std::fabs(dir[a]) < 1e-8f) {
+                if (origin[a] < lo || origin[a] > hi)
+                    return false;   //Parallel to and outside this slab
+                continue;
+            }
+            float t0 = (lo - origin[a]) / dir[a];
+            float t1 = (hi - origin[a]) / dir[a];
+            if (t0 > t1)
+                std::swap(t0, t1);
+            tEnter = std::max(tEnter, t0);
+            tExit = std::min(tExit, t1);
+        }
+        if (tEnter > tExit)
+            return false;
+
+        //Walk the cells the ray passes through (3D DDA)
+        glm::vec3 start = origin + dir * tEnter;
+        int cell[3], step[3];
+        float tMax[3], tDelta[3];
+        for (int a = 0; a < 3; a++) {
+            cell[a] = cellCoord(start[a], a);
+            if (dir[a] > 0.f) {
+                step[a] = 1;
+                tMax[a] = tEnter + (gridMin[a] + (cell[a] + 1) * cellSize - start[a]) / dir[a];
+                tDelta[a] = cellSize / dir[a];
+            }
+            else if (dir[a] < 0.f) {
+                step[a] = -1;
+                tMax[a] = tEnter + (gridMin[a] + cell[a] * cellSize - start[a]) / dir[a];
+                tDelta[a] = -cellSize / dir[a];
+            }
+            else {
+                step[a] = 0;
+                tMax[a] = FLT_MAX;
+                tDelta[a] = FLT_MAX;
+            }
+        }
+
+        float best = maxDist;
+        int bestEntry = -1;
+        while (true) {
+            int c = cellIndex(cell[0], cell[1], cell[2]);
+            for (int i = cellStart[c]; i < cellStart[c + 1]; i++) {
+                int e = cellEntries[i];
+                float t;
+                if (raySphere(origin, dir, centers[e], radii[e], &t) && t <= best) {
+                    best = t;
+                    bestEntry = e;
+                }
+            }
+
+            //Stop once the nearest hit is inside the cells already visited
+            int axis = (tMax[0] < tMax[1]) ? (tMax[0] < tMax[2] ? 0 : 2) : (tMax[1] < tMax[2] ? 1 : 2);
+            if (tMax[axis] > tExit || (bestEntry >= 0 && best <= tMax[axis]))
+                break;
+            cell[axis] += step[axis];
+            if (cell[axis] < 0 || cell[axis] >= dims[axis])
+                break;
+            tMax[axis] += tDelta[axis];
+        }
+
+        if (bestEntry < 0)
+            return false;
+        hit->index = ids[bestEntry];
+        hit->distance = best;
+        hit->point = origin + dir * best;
+        return true;
+    }
+
+    //Finds every particle overlapping a sphere
+    // @param center - Center of the query sphere
+    // @param radius - Radius of the query sphere
+    // @param results - Particle indices are appended here
+    // @return Number of particles found
+    int queryRadius(glm::vec3 center, float radius, std::vector<int>& results) const {
+        if (ids.empty())
+            return 0;
+        int lo[3], hi[3];
+        if (!boxCells(center - radius, center + radius, lo, hi))
+            return 0;
+
+        int found = 0;
+        for (int z = lo[2]; z <= hi[2]; z++)
+            for (int y = lo[1]; y <= hi[1]; y++)
+                for (int x = lo[0]; x <= hi[0]; x++) {
+                    int c = cellIndex(x, y, z);
+                    for (int i = cellStart[c]; i < cellStart[c + 1]; i++) {
+                        int e = cellEntries[i];
+
+                        //Entries can span several cells. Only report one from the first cell both ranges share
+                        int eLo[3], eHi[3];
+                        sphereCells(centers[e], radii[e], eLo, eHi);
+                        if (std::max(eLo[0], lo[0]) != x || std::max(eLo[1], lo[1]) != y || std::max(eLo[2], lo[2]) != z)
+                            continue;
+
+                        glm::vec3 d = centers[e] - center;
+                        float reach = radius + radii[e];
+                        if (glm::dot(d, d) <= reach * reach) {
+                            results.push_back(ids[e]);
+                            found++;
+                        }
+                    }
+                }
+        return found;
+    }
+
+    //Finds the k particles with centers closest to a point
+    // @param point - Query position
+    // @param k - Number of neighbours wanted
+    // @param results - Particle indices are appended here, nearest first
+    // @return Number of particles found (less than k if there aren't enough live particles)
+    int queryNearest(glm::vec3 point, int k, std::vector<int>& results) const {
+        if (ids.empty() || k <= 0)
+            return 0;
+
+        //Max-heap of (squared distance, entry) holding the best k so far
+        std::vector<std::pair<float, int> > best;
+        best.reserve(k + 1);
+
+        int pc[3], maxRing = 0;
+        for (int a = 0; a < 3; a++) {
+            pc[a] = (int)std::floor((point[a] - gridMin[a]) / cellSize);
+            maxRing = std::max(maxRing, std::max(std::abs(pc[a]), std::abs(dims[a] - 1 - pc[a])));
+        }
+
+        //Visit shells of cells around the point until nothing unvisited can be closer
+        for (int ring = 0; ring <= maxRing; ring++) {
+            for (int z = std::max(0, pc[2] - ring); z <= std::min(dims[2] - 1, pc[2] + ring); z++)
+                for (int y = std::max(0, pc[1] - ring); y <= std::min(dims[1] - 1, pc[1] + ring); y++) {
+                    bool onShell = std::abs(z - pc[2]) == ring || std::abs(y - pc[1]) == ring;
+                    int xStep = (onShell || ring == 0) ? 1 : 2 * ring;  //Inside the shell only the two x faces are new
+                    for (int x = pc[0] - ring; x <= pc[0] + ring; x += xStep) {
+                        if (x < 0 || x >= dims[0])
+                            continue;
+                        int c = cellIndex(x, y, z);
+                        for (int i = cellStart[c]; i < cellStart[c + 1]; i++) {
+                            int e = cellEntries[i];
+                            if (homeCell[e] != c)
+                                continue;   //Counted from its center's cell only
+                            glm::vec3 d = centers[e] - point;
+                            float dist = glm::dot(d, d);
+                            if ((int)best.size() < k) {
+                                best.push_back(std::make_pair(dist, e));
+                                std::push_heap(best.begin(), best.end());
+                            }
+                            else if (dist < best.front().first) {
+                                std::pop_heap(best.begin(), best.end());
+                                best.back() = std::make_pair(dist, e);
+                                std::push_heap(best.begin(), best.end());
+                            }
+                        }
+                    }
+                }
+
+            float covered = ring * cellSize;
+            if ((int)best.size() == k && best.front().first <= covered * covered)
+                break;
+        }
+
+        std::sort_heap(best.begin(), best.end());
+        for (size_t i = 0; i < best.size(); i++)
+            results.push_back(ids[best[i].second]);
+        return (int)best.size();
+    }
+
+    //Raycasts many rays across threads
+    // @param hits - Array of count results
+    void raycastBatch(const glm::vec3* origins, const glm::vec3* dirs, int count, float maxDist, RayHit* hits) const {
+        parallelFor(count, QUERY_BATCH_MIN, [&](int begin, int end) {
+            for (int i = begin; i < end; i++)
+                raycast(origins[i], dirs[i], maxDist, &hits[i]);
+        });
+    }
+
+    //Radius queries for many spheres across threads
+    // @param results - Resized to count. Keep it alive between frames to reuse its memory
+    void queryRadiusBatch(const glm::vec3* queryCenters, const float* queryRadii, int count, std::vector<std::vector<int> >& results) const {
+        results.resize(count);
+        parallelFor(count, QUERY_BATCH_MIN, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                results[i].clear();
+                queryRadius(queryCenters[i], queryRadii[i], results[i]);
+            }
+        });
+    }
+
+    //k-nearest queries for many points across threads
+    // @param results - Array of count * k indices. Missing neighbours are left as -1
+    void queryNearestBatch(const glm::vec3* points, int count, int k, int* results) const {
+        parallelFor(count, QUERY_BATCH_MIN, [&](int begin, int end) {
+            std::vector<int> local;
+            local.reserve(k);
+            for (int i = begin; i < end; i++) {
+                local.clear();
+                queryNearest(points[i], k, local);
+                for (int j = 0; j < k; j++)
+                    results[i * k + j] = j < (int)local.size() ? local[j] : -1;
+            }
+        });
+    }
+
+private:
+    int cellIndex(int x, int y, int z) const {
+        return x + dims[0] * (y + dims[1] * z);
+    }
+
+    //Grid cell along one axis, clamped into the grid
+    int cellCoord(float value, int axis) const {
+        int cell = (int)std::floor((value - gridMin[axis]) / cellSize);
+        return std::min(dims[axis] - 1, std::max(0, cell));
+    }
+
+    void sphereCells(glm::vec3 center, float radius, int* lo, int* hi) const {
+        for (int a = 0; a < 3; a++) {
+            lo[a] = cellCoord(center[a] - radius, a);
+            hi[a] = cellCoord(center[a] + radius, a);
+        }
+    }
+
+    //Cell range covered by a box. False when the box misses the grid
+    bool boxCells(glm::vec3 boxMin, glm::vec3 boxMax, int* lo, int* hi) const {
+        for (int a = 0; a < 3; a++) {
+            float gridMax = gridMin[a] + dims[a] * cellSize;
+            if (boxMax[a] < gridMin[a] || boxMin[a] > gridMax)
+                return false;
+            lo[a] = cellCoord(boxMin[a], a);
+            hi[a] = cellCoord(boxMax[a], a);
+        }
+        return true;
+    }
+
+    //Ray (normalized dir) vs sphere. Rays starting inside a sphere hit at t = 0
+    static bool raySphere(glm::vec3 origin, glm::vec3 dir, glm::vec3 center, float radius, float* t) {
+        glm::vec3 m = origin - center;
+        float b = glm::dot(m, dir);
+        float c = glm::dot(m, m) - radius * radius;
+        if (c > 0.f && b > 0.f)
+            return false;   //Outside and pointing away
+        float disc = b * b - c;
+        if (disc < 0.f)
+            return false;
+        *t = std::max(0.f, -b - std::sqrt(disc));
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,334 @@
+#ifndef SPH_FILE
+#define SPH_FILE
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cfloat>
+#include <cmath>
+#include "parallel.h"
+#include "morton.h"
+#include "simd.h"
+
+#define SPH_BATCH_MIN 256       //Particles per thread before a pass is split
+#define SPH_PI 3.14159265f
+
+//Smoothed particle hydrodynamics over a cell grid.
+//step() sorts the fluid by grid cell (Morton order of the cells), builds neighbour lists
+//and computes density, pressure and viscosity. Every pass is split across threads and the
+//kernel sums over each neighbour list run 4 neighbours at a time with SSE.
+class SPHSolver {
+public:
+    float smoothingRadius = 1.f;    //h. Also the grid cell size
+    float restDensity = 8.f;        //Target density. mass / spacing^3
+    float stiffness = 40.f;         //Pressure per unit of density above rest
+    float viscosity = 0.5f;
+    glm::vec3 boundsMin = glm::vec3(-5.f, -5.f, -5.f);     //Container walls
+    glm::vec3 boundsMax = glm::vec3(5.f, 5.f, 5.f);
+    float wallStiffness = 500.f;    //Penalty acceleration per unit of penetration
+    float wallDamping = 5.f;
+
+    std::vector<glm::vec3> forces;  //Result of step(), in the caller's particle order
+
+    //Sorted particle data (structure of arrays)
+    std::vector<float> px, py, pz, vx, vy, vz, mass, density, pressure;
+    std::vector<int> sortedToOriginal;
+
+    //Neighbours of sorted particle i are neighbours[neighbourStart[i] .. neighbourStart[i + 1]] (self included)
+    std::vector<int> neighbourStart;
+    std::vector<int> neighbours;
+
+    //Runs one solve
+    // @param positions, velocities, masses - Fluid particles in the caller's order
+    // @param count - Number of fluid particles
+    void step(const glm::vec3* positions, const glm::vec3* velocities, const float* masses, int count) {
+        forces.assign(count, glm::vec3(0.f));
+        if (count <= 0)
+            return;
+
+        sortByCell(positions, velocities, masses, count);
+        buildCellTable();
+        buildNeighbours();
+
+        //Densities then pressures
+        float h2 = smoothingRadius * smoothingRadius;
+        float poly6 = 315.f / (64.f * SPH_PI * std::pow(smoothingRadius, 9.f));
+        parallelFor(count, SPH_BATCH_MIN, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                density[i] = std::max(poly6 * densitySum(i, h2), 1e-6f);
+                pressure[i] = std::max(0.f, stiffness * (density[i] - restDensity));
+            }
+        });
+
+        //Forces
+        float gradCoef = 45.f / (SPH_PI * std::pow(smoothingRadius, 6.f));
+        parallelFor(count, SPH_BATCH_MIN, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                glm::vec3 pressureAcc, viscosityAcc;
+                forceSums(i, &pressureAcc, &viscosityAcc);
+
+                glm::vec3 acc = (-gradCoef / density[i]) * pressureAcc
+                    + (viscosity * gradCoef / density[i]) * viscosityAcc
+                    + wallAcceleration(i);
+                forces[sortedToOriginal[i]] = acc * mass[i];
+            }
+        });
+    }
+
+private:
+    glm::vec3 gridMin;
+    std::vector<uint64_t> cellCodes;    //Morton code of each sorted particle's cell
+    std::vector<uint64_t> runCodes;     //One entry per occupied cell
+    std::vector<int> runStart;          //Sorted particle range of each occupied cell
+    std::vector<int> table;             //Open addressing hash of cell code -> run index
+    uint64_t tableMask = 0;
+    std::vector<glm::vec3> gatherScratch;
+
+    void cellOf(float x, float y, float z, int* cell) const {
+        float inv = 1.f / smoothingRadius;
+        cell[0] = (int)((x - gridMin.x) * inv);
+        cell[1] = (int)((y - gridMin.y) * inv);
+        cell[2] = (int)((z - gridMin.z) * inv);
+    }
+
+    static uint64_t cellCode(int x, int y, int z) {
+        return expandMortonBits(x) | (expandMortonBits(y) << 1) | (expandMortonBits(z) << 2);
+    }
+
+    static uint64_t hashCode(uint64_t code) {
+        code ^= code >> 33;
+        code *= 0xff51afd7ed558ccdULL;
+        code ^= code >> 33;
+        return code;
+    }
+
+    //Sorts particles by the Morton code of their cell so cells and neighbours sit together in memory
+    void sortByCell(const glm::vec3* positions, const glm::vec3* velocities, const float* masses, int count) {
+        gridMin = glm::vec3(FLT_MAX);
+        for (int i = 0; i < count; i++)
+            gridMin = glm::min(gridMin, positions[i]);
+
+        cellCodes.resize(count);
+        sortedToOriginal.resize(count);
+        parallelFor(count, SPH_BATCH_MIN, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                int cell[3];
+                cellOf(positions[i].x, positions[i].y, positions[i].z, cell);
+                cellCodes[i] = cellCode(cell[0], cell[1], cell[2]);
+                sortedToOriginal[i] = i;
+            }
+        });
+        radixSortPairs(cellCodes, sortedToOriginal);
+
+        px.resize(count); py.resize(count); pz.resize(count);
+        vx.resize(count); vy.resize(count); vz.resize(count);
+        mass.resize(count); density.resize(count); pressure.resize(count);
+        parallelFor(count, SPH_BATCH_MIN, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                int src = sortedToOriginal[i];
+                px[i] = positions[src].x; py[i] = positions[src].y; pz[i] = positions[src].z;
+                vx[i] = velocities[src].x; vy[i] = velocities[src].y; vz[i] = velocities[src].z;
+                mass[i] = masses[src];
+            }
+        });
+    }
+
+    //Groups the sorted particles into runs of one cell and hashes each run by its cell code
+    void buildCellTable() {
+        int count = (int)cellCodes.size();
+        runCodes.clear();
+        runStart.clear();
+        for (int i = 0; i < count; i++) {
+            if (i == 0 || cellCodes[i] != cellCodes[i - 1]) {
+                runCodes.push_back(cellCodes[i]);
+                runStart.push_back(i);
+            }
+        }
+        runStart.push_back(count);
+
+        uint64_t tableSize = 1;
+        while (tableSize < runCodes.size() * 2)
+            tableSize <<= 1;
+        tableMask = tableSize - 1;
+        table.assign((size_t)tableSize, -1);
+        for (size_t r = 0; r < runCodes.size(); r++) {
+            uint64_t slot = hashCode(runCodes[r]) & tableMask;
+            while (table[(size_t)slot] != -1)
+                slot = (slot + 1) & tableMask;
+            table[(size_t)slot] = (int)r;
+        }
+    }
+
+    //Run index for a cell, -1 when it's empty
+    int findRun(uint64_t code) const {
+        uint64_t slot = hashCode(code) & tableMask;
+        while (table[(size_t)slot] != -1) {
+            int run = table[(size_t)slot];
+            if (runCodes[run] == code)
+                return run;
+            slot = (slot + 1) & tableMask;
+        }
+        return -1;
+    }
+
+    //Visits every particle within h of sorted particle i, itself included
+    template <typename Func>
+    void forEachNeighbour(int i, Func func) const {
+        float h2 = smoothingRadius * smoothingRadius;
+        int cell[3];
+        cellOf(px[i], py[i], pz[i], cell);
+        for (int dz = -1; dz <= 1; dz++)
+            for (int dy = -1; dy <= 1; dy++)
+                for (int dx = -1; dx <= 1; dx++) {
+                    int x = cell[0] + dx, y = cell[1] + dy, z = cell[2] + dz;
+                    if (x < 0 || y < 0 || z < 0)
+                        continue;   //Grid starts at the lowest particle
+                    int run = findRun(cellCode(x, y, z));
+                    if (run < 0)
+                        continue;
+                    for (int j = runStart[run]; j < runStart[run + 1]; j++) {
+                        float rx = px[j] - px[i], ry = py[j] - py[i], rz = pz[j] - pz[i];
+                        if (rx * rx + ry * ry + rz * rz < h2)
+                            func(j);
+                    }
+                }
+    }
+
+    //Neighbour lists in two parallel passes: count, prefix sum, then fill
+    void buildNeighbours() {
+        int count = (int)px.size();
+        neighbourStart.assign(count + 1, 0);
+        parallelFor(count, SPH_BATCH_MIN, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                int found = 0;
+                forEachNeighbour(i, [&found](int) { found++; });
+                neighbourStart[i + 1] = found;
+            }
+        });
+        for (int i = 0; i < count; i++)
+            neighbourStart[i + 1] += neighbourStart[i];
+
+        neighbours.resize(neighbourStart[count]);
+        parallelFor(count, SPH_BATCH_MIN, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                int cursor = neighbourStart[i];
+                forEachNeighbour(i, [&](int j) { neighbours[cursor++] = j; });
+            }
+        });
+    }
+
+    //Sum of m_j * (h^2 - r^2)^3 over the neighbours
+    float densitySum(int i, float h2) const {
+        int k = neighbourStart[i];
+        int end = neighbourStart[i + 1];
+        float sum = 0.f;
+#if USE_SSE
+        __m128 xi = _mm_set1_ps(px[i]), yi = _mm_set1_ps(py[i]), zi = _mm_set1_ps(pz[i]);
+        __m128 h2v = _mm_set1_ps(h2);
+        __m128 acc = _mm_setzero_ps();
+        for (; k + 4 <= end; k += 4) {
+            const int* n = &neighbours[k];
+            __m128 dx = _mm_sub_ps(_mm_setr_ps(px[n[0]], px[n[1]], px[n[2]], px[n[3]]), xi);
+            __m128 dy = _mm_sub_ps(_mm_setr_ps(py[n[0]], py[n[1]], py[n[2]], py[n[3]]), yi);
+            __m128 dz = _mm_sub_ps(_mm_setr_ps(pz[n[0]], pz[n[1]], pz[n[2]], pz[n[3]]), zi);
+            __m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            __m128 d = _mm_max_ps(_mm_sub_ps(h2v, r2), _mm_setzero_ps());
+            __m128 m = _mm_setr_ps(mass[n[0]], mass[n[1]], mass[n[2]], mass[n[3]]);
+            acc = _mm_add_ps(acc, _mm_mul_ps(m, _mm_mul_ps(d, _mm_mul_ps(d, d))));
+        }
+        sum = horizontalSum(acc);
+#endif
+        for (; k < end; k++) {
+            int j = neighbours[k];
+            float rx = px[j] - px[i], ry = py[j] - py[i], rz = pz[j] - pz[i];
+            float d = std::max(0.f, h2 - (rx * rx + ry * ry + rz * rz));
+            sum += mass[j] * d * d * d;
+        }
+        return sum;
+    }
+
+    //Unscaled pressure and viscosity sums over the neighbours (kernel constants applied by the caller)
+    // @param pressureAcc - Sum of m_j * (p_i + p_j) / (2 rho_j) * (h - r)^2 / r * (x_j - x_i)
+    // @param viscosityAcc - Sum of m_j / rho_j * (h - r) * (v_j - v_i)
+    void forceSums(int i, glm::vec3* pressureAcc, glm::vec3* viscosityAcc) const {
+        float h = smoothingRadius;
+        int k = neighbourStart[i];
+        int end = neighbourStart[i + 1];
+        glm::vec3 pSum(0.f), vSum(0.f);
+#if USE_SSE
+        __m128 xi = _mm_set1_ps(px[i]), yi = _mm_set1_ps(py[i]), zi = _mm_set1_ps(pz[i]);
+        __m128 vxi = _mm_set1_ps(vx[i]), vyi = _mm_set1_ps(vy[i]), vzi = _mm_set1_ps(vz[i]);
+        __m128 pi = _mm_set1_ps(pressure[i]);
+        __m128 hv = _mm_set1_ps(h);
+        __m128 half = _mm_set1_ps(0.5f);
+        __m128 eps = _mm_set1_ps(1e-12f);
+        __m128 pxAcc = _mm_setzero_ps(), pyAcc = _mm_setzero_ps(), pzAcc = _mm_setzero_ps();
+        __m128 vxAcc = _mm_setzero_ps(), vyAcc = _mm_setzero_ps(), vzAcc = _mm_setzero_ps();
+        for (; k + 4 <= end; k += 4) {
+            const int* n = &neighbours[k];
+            __m128 dx = _mm_sub_ps(_mm_setr_ps(px[n[0]], px[n[1]], px[n[2]], px[n[3]]), xi);
+            __m128 dy = _mm_sub_ps(_mm_setr_ps(py[n[0]], py[n[1]], py[n[2]], py[n[3]]), yi);
+            __m128 dz = _mm_sub_ps(_mm_setr_ps(pz[n[0]], pz[n[1]], pz[n[2]], pz[n[3]]), zi);
+            __m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            __m128 valid = _mm_cmpgt_ps(r2, eps);       //Skips itself and exact overlaps
+            __m128 r = _mm_sqrt_ps(r2);
+            __m128 hr = _mm_max_ps(_mm_sub_ps(hv, r), _mm_setzero_ps());
+
+            __m128 m = _mm_setr_ps(mass[n[0]], mass[n[1]], mass[n[2]], mass[n[3]]);
+            __m128 rhoJ = _mm_setr_ps(density[n[0]], density[n[1]], density[n[2]], density[n[3]]);
+            __m128 pJ = _mm_setr_ps(pressure[n[0]], pressure[n[1]], pressure[n[2]], pressure[n[3]]);
+            __m128 mOverRho = _mm_div_ps(m, rhoJ);
+
+            //Pressure: spiky gradient
+            __m128 pTerm = _mm_mul_ps(_mm_mul_ps(mOverRho, _mm_mul_ps(_mm_add_ps(pi, pJ), half)),
+                _mm_div_ps(_mm_mul_ps(hr, hr), _mm_max_ps(r, eps)));
+            pTerm = _mm_and_ps(pTerm, valid);
+            pxAcc = _mm_add_ps(pxAcc, _mm_mul_ps(pTerm, dx));
+            pyAcc = _mm_add_ps(pyAcc, _mm_mul_ps(pTerm, dy));
+            pzAcc = _mm_add_ps(pzAcc, _mm_mul_ps(pTerm, dz));
+
+            //Viscosity: laplacian kernel
+            __m128 vTerm = _mm_and_ps(_mm_mul_ps(mOverRho, hr), valid);
+            vxAcc = _mm_add_ps(vxAcc, _mm_mul_ps(vTerm, _mm_sub_ps(_mm_setr_ps(vx[n[0]], vx[n[1]], vx[n[2]], vx[n[3]]), vxi)));
+            vyAcc = _mm_add_ps(vyAcc, _mm_mul_ps(vTerm, _mm_sub_ps(_mm_setr_ps(vy[n[0]], vy[n[1]], vy[n[2]], vy[n[3]]), vyi)));
+            vzAcc = _mm_add_ps(vzAcc, _mm_mul_ps(vTerm, _mm_sub_ps(_mm_setr_ps(vz[n[0]], vz[n[1]], vz[n[2]], vz[n[3]]), vzi)));
+        }
+        pSum = glm::vec3(horizontalSum(pxAcc), horizontalSum(pyAcc), horizontalSum(pzAcc));
+        vSum = glm::vec3(horizontalSum(vxAcc), horizontalSum(vyAcc), horizontalSum(vzAcc));
+#endif
+        for (; k < end; k++) {
+            int j = neighbours[k];
+            glm::vec3 d(px[j] - px[i], py[j] - py[i], pz[j] - pz[i]);
+            float r2 = glm::dot(d, d);
+            if (r2 <= 1e-12f)
+                continue;
+            float r = std::sqrt(r2);
+            float hr = std::max(0.f, h - r);
+            float mOverRho = mass[j] / density[j];
+            pSum += d * (mOverRho * (pressure[i] + pressure[j]) * 0.5f * hr * hr / r);
+            vSum += glm::vec3(vx[j] - vx[i], vy[j] - vy[i], vz[j] - vz[i]) * (mOverRho * hr);
+        }
+        *pressureAcc = pSum;
+        *viscosityAcc = vSum;
+    }
+
+    //Penalty springs pushing particles back inside the container
+    glm::vec3 wallAcceleration(int i) const {
+        float pos[3] = { px[i], py[i], pz[i] };
+        float vel[3] = { vx[i], vy[i], vz[i] };
+        float margin = 0.5f * smoothingRadius;
+        glm::vec3 acc(0.f);
+        for (int a = 0; a < 3; a++) {
+            float below = (boundsMin[a] + margin) - pos[a];
+            float above = pos[a] - (boundsMax[a] - margin);
+            if (below > 0.f)
+                acc[a] += wallStiffness * below - wallDamping * std::min(vel[a], 0.f);
+            if (above > 0.f)
+                acc[a] -= wallStiffness * above + wallDamping * std::max(vel[a], 0.f);
+        }
+        return acc;
+    }
+};
+
+#endif
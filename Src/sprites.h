@@ -0,0 +1,112 @@
+#ifndef SPRITES_FILE
+#define SPRITES_FILE
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <utility>
+#include "framering.h"
+#include "glstate.h"
+
+#define SPRITE_SWITCH_PIXELS 4.f    //Instances whose bounding sphere projects smaller than this radius draw as sprites
+#define SPRITE_POSITION_ATTRIBUTE 0
+#define SPRITE_COLOR_ATTRIBUTE 1
+
+//One camera facing quad: center and world radius, then tint
+struct SpriteData {
+    glm::vec3 position;
+    float size;
+    glm::vec4 color;
+};
+
+//Radius in pixels a sphere covers on screen
+// @param viewCenter - Sphere center in view space
+// @param radius - World radius
+inline float projectedRadius(const glm::vec3& viewCenter, float radius, const glm::mat4& projection, float screenHeight) {
+    float pixels = radius * projection[1][1] * screenHeight * 0.5f;
+    if (projection[3][3] == 0.f) {  //Perspective shrinks with distance
+        float depth = -viewCenter.z;
+        if (depth <= radius)
+            return 1e30f;   //Camera is inside or right at the sphere
+        pixels /= depth;
+    }
+    return pixels;
+}
+
+//Particles too small on screen for their mesh, drawn as round textured quads in one instanced
+//triangle strip draw. The quads are built in the vertex shader from a single position/size/color stream
+//in a FrameRingBuffer. Translucent batches are sorted back to front before upload
+class SpriteBatch {
+public:
+    GLuint VAO = 0;
+    int count = 0;                      //Sprites in the last upload
+    bool blended = false;               //Some sprite has alpha below 1
+    std::vector<SpriteData> sprites;    //Collected this frame
+
+    void create() {
+        glGenVertexArrays(1, &VAO);
+        glState().bindVertexArray(VAO);
+        glVertexAttribDivisor(SPRITE_POSITION_ATTRIBUTE, 1);
+        glVertexAttribDivisor(SPRITE_COLOR_ATTRIBUTE, 1);
+        glEnableVertexAttribArray(SPRITE_POSITION_ATTRIBUTE);
+        glEnableVertexAttribArray(SPRITE_COLOR_ATTRIBUTE);
+        glState().bindVertexArray(0);
+    }
+
+    void clear() {
+        sprites.clear();
+        blended = false;
+    }
+
+    void add(const glm::vec3& position, float size, const glm::vec4& color) {
+        SpriteData sprite = { position, size, color };
+        sprites.push_back(sprite);
+        blended = blended || color.a < 1.f;
+    }
+
+    //Writes the collected sprites into this frame's part of the ring and points the VAO at them
+    // @param view - Orders translucent sprites back to front
+    void upload(FrameRingBuffer& ring, const glm::mat4& view) {
+        count = (int)sprites.size();
+        if (count == 0)
+            return;
+
+        GLintptr offset;
+        size_t bytes = sizeof(SpriteData) * (size_t)count;
+        SpriteData* mapped = (SpriteData*)ring.allocate(bytes, offset);
+        if (blended) {
+            order.resize(count);
+            for (int i = 0; i < count; i++)
+                order[i] = std::make_pair((view * glm::vec4(sprites[i].position, 1.f)).z, i);
+            std::sort(order.begin(), order.end());  //Most negative view z is farthest
+            for (int i = 0; i < count; i++)
+                mapped[i] = sprites[order[i].second];
+        }
+        else
+            std::memcpy(mapped, sprites.data(), bytes);
+        ring.commit(offset, bytes);
+
+        glState().bindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, ring.buffer);
+        glVertexAttribPointer(SPRITE_POSITION_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteData), (void*)offset);
+        glVertexAttribPointer(SPRITE_COLOR_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteData), (void*)(offset + offsetof(SpriteData, color)));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glState().bindVertexArray(0);
+    }
+
+    void destroy() {
+        if (VAO) {
+            glState().deletedVertexArray(VAO);
+            glDeleteVertexArrays(1, &VAO);
+        }
+        VAO = 0;
+    }
+
+private:
+    std::vector<std::pair<float, int>> order;   //View z and sprite, for sorting
+};
+
+#endif
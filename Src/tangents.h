@@ -0,0 +1,165 @@
+#ifndef TANGENTS_FILE
+#define TANGENTS_FILE
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "parallel.h"
+#include "simd.h"
+
+#ifndef MESH_STRIDE
+#define MESH_STRIDE 14              //Floats per vertex: XYZ, normal XYZ, UV, tan XYZ, bitan XYZ
+#endif
+#define TANGENT_UV_OFFSET 6
+#define TANGENT_OFFSET 8
+#define BITANGENT_OFFSET 11
+#define TANGENT_MIN_PER_THREAD 8192 //Triangles or vertices per thread
+
+//Per triangle tangent frames in SoA arrays so 4 triangles fill one SSE register
+struct TriangleFrames {
+    std::vector<float> tx, ty, tz, bx, by, bz;
+
+    void resize(int count) {
+        int padded = (count + 3) & ~3;
+        tx.resize(padded); ty.resize(padded); tz.resize(padded);
+        bx.resize(padded); by.resize(padded); bz.resize(padded);
+    }
+};
+
+//Corner c of triangle t. Flat lists have no index buffer
+inline unsigned int cornerVertex(const GLuint* indices, int t, int c) {
+    return indices ? indices[t * 3 + c] : (unsigned int)(t * 3 + c);
+}
+
+//Tangent and bitangent of triangles [begin, end) from positions and UVs.
+//Triangles with no UV area get a zero frame instead of infinities
+inline void triangleFrames(const GLfloat* vertices, const GLuint* indices, int begin, int end, TriangleFrames& frames) {
+    int t = begin;
+#if USE_SSE
+    for (; t + 4 <= end; t += 4) {
+        float lanes[3][5][4];   //Corner, (x, y, z, u, v), triangle
+        for (int lane = 0; lane < 4; lane++)
+            for (int c = 0; c < 3; c++) {
+                const GLfloat* vertex = &vertices[cornerVertex(indices, t + lane, c) * MESH_STRIDE];
+                lanes[c][0][lane] = vertex[0];
+                lanes[c][1][lane] = vertex[1];
+                lanes[c][2][lane] = vertex[2];
+                lanes[c][3][lane] = vertex[TANGENT_UV_OFFSET];
+                lanes[c][4][lane] = vertex[TANGENT_UV_OFFSET + 1];
+            }
+        __m128 v1[5], v2[5], v3[5];
+        for (int k = 0; k < 5; k++) {
+            v1[k] = _mm_loadu_ps(lanes[0][k]);
+            v2[k] = _mm_loadu_ps(lanes[1][k]);
+            v3[k] = _mm_loadu_ps(lanes[2][k]);
+        }
+
+        __m128 du1x = _mm_sub_ps(v2[3], v1[3]), du1y = _mm_sub_ps(v2[4], v1[4]);
+        __m128 du2x = _mm_sub_ps(v3[3], v1[3]), du2y = _mm_sub_ps(v3[4], v1[4]);
+        __m128 det = _mm_sub_ps(_mm_mul_ps(du1x, du2y), _mm_mul_ps(du1y, du2x));
+        __m128 r = _mm_and_ps(_mm_cmpneq_ps(det, _mm_setzero_ps()), _mm_div_ps(_mm_set1_ps(1.f), det));
+
+        float* tangentOut[3] = { &frames.tx[t], &frames.ty[t], &frames.tz[t] };
+        float* bitangentOut[3] = { &frames.bx[t], &frames.by[t], &frames.bz[t] };
+        for (int k = 0; k < 3; k++) {
+            __m128 dp1 = _mm_sub_ps(v2[k], v1[k]);
+            __m128 dp2 = _mm_sub_ps(v3[k], v1[k]);
+            _mm_storeu_ps(tangentOut[k], _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(dp1, du2y), _mm_mul_ps(dp2, du1y)), r));
+            _mm_storeu_ps(bitangentOut[k], _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(dp2, du1x), _mm_mul_ps(dp1, du2x)), r));
+        }
+    }
+#endif
+    for (; t < end; t++) {
+        const GLfloat* a = &vertices[cornerVertex(indices, t, 0) * MESH_STRIDE];
+        const GLfloat* b = &vertices[cornerVertex(indices, t, 1) * MESH_STRIDE];
+        const GLfloat* c = &vertices[cornerVertex(indices, t, 2) * MESH_STRIDE];
+        glm::vec3 deltaPos1 = glm::vec3(b[0], b[1], b[2]) - glm::vec3(a[0], a[1], a[2]);
+        glm::vec3 deltaPos2 = glm::vec3(c[0], c[1], c[2]) - glm::vec3(a[0], a[1], a[2]);
+        glm::vec2 deltaUV1 = glm::vec2(b[TANGENT_UV_OFFSET], b[TANGENT_UV_OFFSET + 1]) - glm::vec2(a[TANGENT_UV_OFFSET], a[TANGENT_UV_OFFSET + 1]);
+        glm::vec2 deltaUV2 = glm::vec2(c[TANGENT_UV_OFFSET], c[TANGENT_UV_OFFSET + 1]) - glm::vec2(a[TANGENT_UV_OFFSET], a[TANGENT_UV_OFFSET + 1]);
+
+        float det = (deltaUV1.x * deltaUV2.y) - (deltaUV1.y * deltaUV2.x);
+        float r = det != 0.f ? 1.0f / det : 0.f;
+        glm::vec3 tangent = (deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y) * r;
+        glm::vec3 bitangent = (deltaPos2 * deltaUV1.x - deltaPos1 * deltaUV2.x) * r;
+        frames.tx[t] = tangent.x; frames.ty[t] = tangent.y; frames.tz[t] = tangent.z;
+        frames.bx[t] = bitangent.x; frames.by[t] = bitangent.y; frames.bz[t] = bitangent.z;
+    }
+}
+
+//Scales a vec3 inside the vertex array to unit length. Zero vectors are left alone
+inline void normalizeInPlace(GLfloat* v) {
+    float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (length > 0.f) {
+        float inv = 1.f / length;
+        v[0] *= inv; v[1] *= inv; v[2] *= inv;
+    }
+}
+
+//Fills the tangent and bitangent of every vertex in an interleaved 14 float array
+// @param vertices - XYZ and UV are read, tangent and bitangent are written
+// @param vertexCount - Number of vertices
+// @param indices - 3 per triangle, or NULL when every 3 vertices are a triangle of their own
+// @param indexCount - Number of indices (ignored without indices)
+// @param smooth - Average the frames of all triangles sharing a vertex. Otherwise a shared vertex keeps its first triangle's frame
+inline void generateTangents(GLfloat* vertices, int vertexCount, const GLuint* indices, int indexCount, bool smooth) {
+    int triangleCount = (indices ? indexCount : vertexCount) / 3;
+    TriangleFrames frames;
+    frames.resize(triangleCount);
+    parallelFor((triangleCount + 3) / 4, TANGENT_MIN_PER_THREAD / 4, [&](int begin, int end) {
+        triangleFrames(vertices, indices, begin * 4, std::min(end * 4, triangleCount), frames);
+    });
+
+    if (!indices) {
+        //Unshared vertices, each takes its triangle's frame
+        parallelFor(triangleCount, TANGENT_MIN_PER_THREAD, [&](int begin, int end) {
+            for (int t = begin; t < end; t++)
+                for (int c = 0; c < 3; c++) {
+                    GLfloat* vertex = &vertices[(t * 3 + c) * MESH_STRIDE];
+                    vertex[TANGENT_OFFSET] = frames.tx[t];
+                    vertex[TANGENT_OFFSET + 1] = frames.ty[t];
+                    vertex[TANGENT_OFFSET + 2] = frames.tz[t];
+                    vertex[BITANGENT_OFFSET] = frames.bx[t];
+                    vertex[BITANGENT_OFFSET + 1] = frames.by[t];
+                    vertex[BITANGENT_OFFSET + 2] = frames.bz[t];
+                }
+        });
+        return;
+    }
+
+    //Triangles around each vertex (CSR) so every vertex is written by one thread only
+    std::vector<int> start(vertexCount + 1, 0);
+    for (int i = 0; i < indexCount; i++)
+        start[indices[i] + 1]++;
+    for (int v = 0; v < vertexCount; v++)
+        start[v + 1] += start[v];
+    std::vector<int> triangleOf(indexCount);
+    std::vector<int> cursor(start.begin(), start.end() - 1);
+    for (int i = 0; i < indexCount; i++)
+        triangleOf[cursor[indices[i]]++] = i / 3;
+
+    parallelFor(vertexCount, TANGENT_MIN_PER_THREAD, [&](int begin, int end) {
+        for (int v = begin; v < end; v++) {
+            GLfloat* vertex = &vertices[v * MESH_STRIDE];
+            int first = start[v], last = smooth ? start[v + 1] : std::min(start[v] + 1, start[v + 1]);
+            float sum[6] = { 0.f, 0.f, 0.f, 0.f, 0.f, 0.f };
+            for (int k = first; k < last; k++) {
+                int t = triangleOf[k];
+                sum[0] += frames.tx[t]; sum[1] += frames.ty[t]; sum[2] += frames.tz[t];
+                sum[3] += frames.bx[t]; sum[4] += frames.by[t]; sum[5] += frames.bz[t];
+            }
+            for (int k = 0; k < 3; k++) {
+                vertex[TANGENT_OFFSET + k] = sum[k];
+                vertex[BITANGENT_OFFSET + k] = sum[3 + k];
+            }
+            if (smooth) {
+                normalizeInPlace(&vertex[TANGENT_OFFSET]);
+                normalizeInPlace(&vertex[BITANGENT_OFFSET]);
+            }
+        }
+    });
+}
+
+#endif
@@ -0,0 +1,415 @@
+#ifndef TEXTURE_COMPRESS_FILE
+#define TEXTURE_COMPRESS_FILE
+
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <climits>
+#include "mappedfile.h"
+#include "parallel.h"
+#include "simd.h"
+#include "texturestream.h"
+#include "imagedecode.h"
+
+#define COMPRESSED_TEXTURE_MAGIC 0x58455442     //"BTEX"
+#define COMPRESSED_TEXTURE_VERSION 1            //Bump whenever the encoder or the layout changes
+#define COMPRESSED_TEXTURE_EXTENSION ".btex"    //Written next to the image
+#define COMPRESSED_TEXTURE_FLIPPED 1            //Header flags
+#define COMPRESSED_TEXTURE_NORMAL_MAP 2
+#define COMPRESS_MIN_ROWS_PER_THREAD 16         //Block rows per thread
+
+//Start of a compressed texture cache file. Every mip level's blocks follow, largest first
+struct CompressedTextureHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t format;        //GL_COMPRESSED_* internal format
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipCount;
+    uint32_t flags;         //COMPRESSED_TEXTURE_FLIPPED, COMPRESSED_TEXTURE_NORMAL_MAP
+    uint32_t reserved;      //Keeps the stamp 8 byte aligned
+    uint64_t sourceSize;    //Size and modified time of the image it was encoded from
+    int64_t sourceTime;
+};
+
+//BCn blocks of a whole mip chain, either freshly encoded or mapped from the cache file
+struct CompressedImage {
+    GLenum format = 0;
+    int width = 0, height = 0, mipCount = 0;
+    const unsigned char* blocks = NULL;     //Every level back to back
+    size_t size = 0;
+
+    std::vector<unsigned char> data;        //Owns blocks after encoding
+    MappedFile file;                        //Owns blocks after loading the cache file
+};
+
+//Bytes per 4x4 block
+inline int blockBytes(GLenum format) {
+    return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+}
+
+//Bytes of one mip level
+inline size_t compressedLevelSize(GLenum format, int width, int height) {
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+//Levels down to 1x1
+inline int mipLevels(int width, int height) {
+    int levels = 1;
+    while (width > 1 || height > 1) {
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+        levels++;
+    }
+    return levels;
+}
+
+//Packs 8 bit RGB into 565
+inline uint16_t packColor565(int r, int g, int b) {
+    return (uint16_t)(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+}
+
+//Expands 565 back to 8 bit RGB the way the GPU does
+inline void unpackColor565(uint16_t c, int* rgb) {
+    int r = c >> 11 & 31, g = c >> 5 & 63, b = c & 31;
+    rgb[0] = r << 3 | r >> 2;
+    rgb[1] = g << 2 | g >> 4;
+    rgb[2] = b << 3 | b >> 2;
+}
+
+//2 bit palette index of every pixel, nearest by squared RGB distance
+// @param block - 16 RGBA pixels, row by row
+// @param palette - 4 expanded colors
+inline uint32_t colorIndices(const unsigned char* block, const int palette[4][3]) {
+    uint32_t indices = 0;
+#if USE_SSE
+    __m128i mask = _mm_set1_epi32(0xff);
+    for (int quad = 0; quad < 4; quad++) {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(block + quad * 16));
+        __m128 r = _mm_cvtepi32_ps(_mm_and_si128(pixels, mask));
+        __m128 g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, 8), mask));
+        __m128 b = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, 16), mask));
+
+        __m128 best = _mm_set1_ps(1e30f);
+        __m128 bestIndex = _mm_setzero_ps();
+        for (int k = 0; k < 4; k++) {
+            __m128 dr = _mm_sub_ps(r, _mm_set1_ps((float)palette[k][0]));
+            __m128 dg = _mm_sub_ps(g, _mm_set1_ps((float)palette[k][1]));
+            __m128 db = _mm_sub_ps(b, _mm_set1_ps((float)palette[k][2]));
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+            __m128 closer = _mm_cmplt_ps(distance, best);
+            best = _mm_min_ps(distance, best);
+            bestIndex = _mm_or_ps(_mm_and_ps(closer, _mm_set1_ps((float)k)), _mm_andnot_ps(closer, bestIndex));
+        }
+        float lanes[4];
+        _mm_storeu_ps(lanes, bestIndex);
+        for (int p = 0; p < 4; p++)
+            indices |= (uint32_t)lanes[p] << ((quad * 4 + p) * 2);
+    }
+#else
+    for (int p = 0; p < 16; p++) {
+        int best = 0, bestDistance = INT_MAX;
+        for (int k = 0; k < 4; k++) {
+            int dr = block[p * 4] - palette[k][0], dg = block[p * 4 + 1] - palette[k][1], db = block[p * 4 + 2] - palette[k][2];
+            int distance = dr * dr + dg * dg + db * db;
+            if (distance < bestDistance) {
+                bestDistance = distance;
+                best = k;
+            }
+        }
+        indices |= (uint32_t)best << (p * 2);
+    }
+#endif
+    return indices;
+}
+
+//BC1 color block. Endpoints span the bounding box diagonal that follows the colors' correlation,
+//inset by 1/16 of the range so the extremes don't dominate (van Waveren's real-time DXT)
+// @param block - 16 RGBA pixels, row by row
+// @param out - 8 bytes
+inline void encodeBC1Block(const unsigned char* block, unsigned char* out) {
+    int low[3], high[3];
+#if USE_SSE
+    __m128i minimum = _mm_loadu_si128((const __m128i*)block), maximum = minimum;
+    for (int quad = 1; quad < 4; quad++) {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(block + quad * 16));
+        minimum = _mm_min_epu8(minimum, pixels);
+        maximum = _mm_max_epu8(maximum, pixels);
+    }
+    minimum = _mm_min_epu8(minimum, _mm_srli_si128(minimum, 8));
+    minimum = _mm_min_epu8(minimum, _mm_srli_si128(minimum, 4));
+    maximum = _mm_max_epu8(maximum, _mm_srli_si128(maximum, 8));
+    maximum = _mm_max_epu8(maximum, _mm_srli_si128(maximum, 4));
+    uint32_t lowBits = (uint32_t)_mm_cvtsi128_si32(minimum), highBits = (uint32_t)_mm_cvtsi128_si32(maximum);
+    for (int c = 0; c < 3; c++) {
+        low[c] = lowBits >> (c * 8) & 0xff;
+        high[c] = highBits >> (c * 8) & 0xff;
+    }
+#else
+    for (int c = 0; c < 3; c++) {
+        low[c] = high[c] = block[c];
+        for (int p = 1; p < 16; p++) {
+            low[c] = std::min(low[c], (int)block[p * 4 + c]);
+            high[c] = std::max(high[c], (int)block[p * 4 + c]);
+        }
+    }
+#endif
+
+    //Flip the channels that fall while the widest one rises
+    int widest = 0;
+    for (int c = 1; c < 3; c++)
+        if (high[c] - low[c] > high[widest] - low[widest])
+            widest = c;
+    int covariance[3] = { 0, 0, 0 };
+    for (int p = 0; p < 16; p++) {
+        int main = block[p * 4 + widest] * 2 - low[widest] - high[widest];
+        for (int c = 0; c < 3; c++)
+            covariance[c] += main * (block[p * 4 + c] * 2 - low[c] - high[c]);
+    }
+    for (int c = 0; c < 3; c++) {
+        if (covariance[c] < 0)
+            std::swap(low[c], high[c]);
+        int inset = (high[c] - low[c]) / 16;
+        high[c] -= inset;
+        low[c] += inset;
+    }
+
+    uint16_t c0 = packColor565(high[0], high[1], high[2]);
+    uint16_t c1 = packColor565(low[0], low[1], low[2]);
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        if (c0 < c1)
+            std::swap(c0, c1);  //c0 > c1 selects the 4 color mode
+        int palette[4][3];
+        unpackColor565(c0, palette[0]);
+        unpackColor565(c1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        indices = colorIndices(block, palette);
+    }
+    out[0] = (unsigned char)(c0 & 0xff);
+    out[1] = (unsigned char)(c0 >> 8);
+    out[2] = (unsigned char)(c1 & 0xff);
+    out[3] = (unsigned char)(c1 >> 8);
+    std::memcpy(out + 4, &indices, 4);
+}
+
+//BC4 single channel block with 8 interpolated values (also BC3's alpha and each half of BC5)
+// @param block - 16 RGBA pixels, row by row
+// @param channel - 0-3, which byte of each pixel to encode
+// @param out - 8 bytes
+inline void encodeBC4Block(const unsigned char* block, int channel, unsigned char* out) {
+    int low = 255, high = 0;
+    for (int p = 0; p < 16; p++) {
+        low = std::min(low, (int)block[p * 4 + channel]);
+        high = std::max(high, (int)block[p * 4 + channel]);
+    }
+    out[0] = (unsigned char)high;   //a0 > a1 selects the 8 value mode
+    out[1] = (unsigned char)low;
+
+    uint64_t indices = 0;
+    if (high > low) {
+        int range = high - low;
+        for (int p = 0; p < 16; p++) {
+            int step = ((block[p * 4 + channel] - low) * 7 + range / 2) / range;   //0 = low ... 7 = high
+            uint64_t index = step == 7 ? 0 : step == 0 ? 1 : (uint64_t)(8 - step);
+            indices |= index << (p * 3);
+        }
+    }
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = (unsigned char)(indices >> (i * 8));
+}
+
+//Encodes one block in the given format
+inline void encodeBlock(GLenum format, const unsigned char* block, unsigned char* out) {
+    switch (format) {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        encodeBC1Block(block, out);
+        break;
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        encodeBC4Block(block, 3, out);      //Alpha
+        encodeBC1Block(block, out + 8);     //Color
+        break;
+    case GL_COMPRESSED_RG_RGTC2:
+        encodeBC4Block(block, 0, out);      //Normal X
+        encodeBC4Block(block, 1, out + 8);  //Normal Y, Z is rebuilt in the shader
+        break;
+    }
+}
+
+//Encodes an RGBA level into blocks. Edge blocks repeat the last row and column
+inline void encodeLevel(GLenum format, const unsigned char* pixels, int width, int height, unsigned char* out) {
+    int blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+    int bytes = blockBytes(format);
+    parallelFor(blocksHigh, COMPRESS_MIN_ROWS_PER_THREAD, [&](int begin, int end) {
+        unsigned char block[64];
+        for (int by = begin; by < end; by++)
+            for (int bx = 0; bx < blocksWide; bx++) {
+                for (int y = 0; y < 4; y++) {
+                    int row = std::min(by * 4 + y, height - 1);
+                    for (int x = 0; x < 4; x++) {
+                        int column = std::min(bx * 4 + x, width - 1);
+                        std::memcpy(&block[(y * 4 + x) * 4], &pixels[((size_t)row * width + column) * 4], 4);
+                    }
+                }
+                encodeBlock(format, block, &out[((size_t)by * blocksWide + bx) * bytes]);
+            }
+    });
+}
+
+//Halves an RGBA image with a 2x2 box filter. Odd edges reuse their last row or column
+inline void downsample(const unsigned char* pixels, int width, int height, std::vector<unsigned char>& out) {
+    int halfWidth = std::max(width / 2, 1), halfHeight = std::max(height / 2, 1);
+    out.resize((size_t)halfWidth * halfHeight * 4);
+    parallelFor(halfHeight, COMPRESS_MIN_ROWS_PER_THREAD * 4, [&](int begin, int end) {
+        for (int y = begin; y < end; y++) {
+            int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+            for (int x = 0; x < halfWidth; x++) {
+                int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+                for (int c = 0; c < 4; c++) {
+                    int sum = pixels[((size_t)y0 * width + x0) * 4 + c] + pixels[((size_t)y0 * width + x1) * 4 + c] +
+                        pixels[((size_t)y1 * width + x0) * 4 + c] + pixels[((size_t)y1 * width + x1) * 4 + c];
+                    out[((size_t)y * halfWidth + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+                }
+            }
+        }
+    });
+}
+
+//Picks BC5 for normal maps, BC3 when any pixel is see-through, BC1 otherwise
+inline GLenum chooseCompressedFormat(const unsigned char* pixels, int width, int height, bool normalMap) {
+    if (normalMap)
+        return GL_COMPRESSED_RG_RGTC2;
+    for (size_t p = 0; p < (size_t)width * height; p++)
+        if (pixels[p * 4 + 3] != 255)
+            return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+}
+
+//Encodes RGBA pixels and their whole mip chain
+// @param pixels - Width * height RGBA pixels
+// @param format - GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT or GL_COMPRESSED_RG_RGTC2
+inline void compressImage(const unsigned char* pixels, int width, int height, GLenum format, CompressedImage& out) {
+    out.format = format;
+    out.width = width;
+    out.height = height;
+    out.mipCount = mipLevels(width, height);
+
+    size_t total = 0;
+    for (int level = 0, w = width, h = height; level < out.mipCount; level++, w = std::max(w / 2, 1), h = std::max(h / 2, 1))
+        total += compressedLevelSize(format, w, h);
+    out.data.resize(total);
+
+    std::vector<unsigned char> current, next;
+    const unsigned char* source = pixels;
+    size_t offset = 0;
+    for (int level = 0, w = width, h = height; level < out.mipCount; level++) {
+        encodeLevel(format, source, w, h, &out.data[offset]);
+        offset += compressedLevelSize(format, w, h);
+        if (level + 1 < out.mipCount) {
+            downsample(source, w, h, next);
+            current.swap(next);
+            source = current.data();
+            w = std::max(w / 2, 1);
+            h = std::max(h / 2, 1);
+        }
+    }
+    out.blocks = out.data.data();
+    out.size = out.data.size();
+}
+
+//Writes the blocks to <path>.btex so later runs skip decoding and encoding
+inline bool writeCompressedTexture(const std::string& path, uint32_t flags, const CompressedImage& image) {
+    CompressedTextureHeader header = { COMPRESSED_TEXTURE_MAGIC, COMPRESSED_TEXTURE_VERSION, image.format,
+        (uint32_t)image.width, (uint32_t)image.height, (uint32_t)image.mipCount, flags, 0, 0, 0 };
+    if (!sourceStamp(path, header.sourceSize, header.sourceTime))
+        return false;
+
+    std::ofstream file((path + COMPRESSED_TEXTURE_EXTENSION).c_str(), std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)image.blocks, image.size);
+    return file.good();
+}
+
+//Maps <path>.btex and checks it against the image. Stale, truncated or differently flagged files are rejected
+inline bool openCompressedTexture(const std::string& path, uint32_t flags, CompressedImage& image) {
+    if (!image.file.open(path + COMPRESSED_TEXTURE_EXTENSION))
+        return false;
+
+    CompressedTextureHeader header;
+    bool valid = image.file.size >= sizeof(header);
+    if (valid) {
+        std::memcpy(&header, image.file.data, sizeof(header));
+        valid = header.magic == COMPRESSED_TEXTURE_MAGIC && header.version == COMPRESSED_TEXTURE_VERSION &&
+            header.flags == flags && header.width > 0 && header.height > 0 &&
+            header.mipCount == (uint32_t)mipLevels(header.width, header.height);
+    }
+    size_t total = 0;
+    if (valid) {
+        for (uint32_t level = 0, w = header.width, h = header.height; level < header.mipCount; level++, w = std::max(w / 2, 1u), h = std::max(h / 2, 1u))
+            total += compressedLevelSize(header.format, w, h);
+        valid = image.file.size == sizeof(header) + total;
+    }
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    if (valid && sourceStamp(path, sourceSize, sourceTime))
+        valid = sourceSize == header.sourceSize && sourceTime == header.sourceTime;
+
+    if (!valid) {
+        image.file.close();
+        return false;
+    }
+    image.format = header.format;
+    image.width = (int)header.width;
+    image.height = (int)header.height;
+    image.mipCount = (int)header.mipCount;
+    image.blocks = image.file.data + sizeof(header);
+    image.size = total;
+    return true;
+}
+
+//Loads the cached blocks of an image, or decodes, encodes and caches it. Safe on any thread
+// @param path - String of the texture file location
+// @param flip - Flip vertically so row 0 is the bottom (what GL_TEXTURE_2D expects)
+// @param normalMap - Keep only X and Y in BC5
+inline bool loadCompressedImage(const std::string& path, bool flip, bool normalMap, CompressedImage& image) {
+    uint32_t flags = (flip ? COMPRESSED_TEXTURE_FLIPPED : 0) | (normalMap ? COMPRESSED_TEXTURE_NORMAL_MAP : 0);
+    if (openCompressedTexture(path, flags, image))
+        return true;
+
+    ImageData decoded;
+    if (!decodeImage(path, flip, decoded))
+        return false;
+    compressImage(decoded.pixels, decoded.width, decoded.height, chooseCompressedFormat(decoded.pixels, decoded.width, decoded.height, normalMap), image);
+    writeCompressedTexture(path, flags, image);
+    return true;
+}
+
+//Uploads every mip level to the bound texture
+// @param target - GL_TEXTURE_2D or a cube map face
+// @param streamer - Copy through its PBO ring instead of handing the driver client memory
+inline void uploadCompressedImage(GLenum target, const CompressedImage& image, TextureStreamer* streamer = NULL) {
+    const void* source = image.blocks;
+    bool streamed = streamer && streamer->stage(image.blocks, image.size, source);
+    size_t offset = 0;
+    for (int level = 0, w = image.width, h = image.height; level < image.mipCount; level++) {
+        size_t size = compressedLevelSize(image.format, w, h);
+        glCompressedTexImage2D(target, level, image.format, w, h, 0, (GLsizei)size, (const unsigned char*)source + offset);
+        offset += size;
+        w = std::max(w / 2, 1);
+        h = std::max(h / 2, 1);
+    }
+    if (streamed)
+        streamer->commit();
+}
+
+#endif
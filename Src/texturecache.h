@@ -0,0 +1,148 @@
+#ifndef TEXTURE_CACHE_FILE
+#define TEXTURE_CACHE_FILE
+
+#include <glad/glad.h>
+#include <string>
+#include <unordered_map>
+#include <memory>
+#include <iostream>
+#include "assetpipeline.h"
+#include "texturestream.h"
+#include "imagedecode.h"
+#include "texcompress.h"
+#include "glstate.h"
+
+//One decoded and uploaded image, shared by every Model using the same file
+struct Texture {
+    std::string path;
+    GLuint id = 0;
+    int width = 0, height = 0;
+    int refCount = 0;
+    bool loading = false;   //Still decoding on the asset pipeline
+};
+
+//Decoded pixels or BCn blocks of one image, filled off the GL thread
+struct TextureData {
+    ImageData image;
+    CompressedImage compressed;
+};
+
+//Loads an image for uploadTexture. Safe on any thread
+// @param path - String of the texture file location
+// @param flip - Flip vertically so row 0 is the bottom
+// @param normalMap - Compress to BC5 (X and Y only)
+// @param compress - Use the BCn cache instead of raw RGBA
+inline bool loadTextureData(const std::string& path, bool flip, bool normalMap, bool compress, TextureData& data) {
+    if (compress)
+        return loadCompressedImage(path, flip, normalMap, data.compressed);
+    return decodeImage(path, flip, data.image);
+}
+
+//Uploads decoded pixels as a mipmapped 2D texture. Creates the GL name if the texture has none yet
+// @param streamer - Copy through its PBO ring instead of handing the driver client memory
+inline void uploadTexture(Texture& texture, const ImageData& image, TextureStreamer* streamer = NULL) {
+    if (!image.pixels)
+        return;
+    if (texture.id == 0)
+        glGenTextures(1, &texture.id);
+    texture.width = image.width;
+    texture.height = image.height;
+    glState().bindTexture(GL_TEXTURE_2D, texture.id);
+
+    //May need to allow for switching between clamp or repeat
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);   //GL_CLAMP edge to extend
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);   //GL_REPEAT repeats
+
+    const void* source = image.pixels;
+    bool streamed = streamer && streamer->stage(image.pixels, (size_t)image.width * image.height * 4, source);
+    glTexImage2D(GL_TEXTURE_2D,
+        0,
+        GL_RGBA,
+        image.width, image.height, 0,
+        GL_RGBA,
+        GL_UNSIGNED_BYTE,
+        source);
+
+    glGenerateMipmap(GL_TEXTURE_2D);  //Mipmaps
+    if (streamed)
+        streamer->commit();
+    glState().bindTexture(GL_TEXTURE_2D, 0);
+}
+
+//Uploads whichever form loadTextureData produced. Compressed images bring their own mip chain
+inline void uploadTexture(Texture& texture, const TextureData& data, TextureStreamer* streamer = NULL) {
+    if (!data.compressed.blocks) {
+        uploadTexture(texture, data.image, streamer);
+        return;
+    }
+    if (texture.id == 0)
+        glGenTextures(1, &texture.id);
+    texture.width = data.compressed.width;
+    texture.height = data.compressed.height;
+    glState().bindTexture(GL_TEXTURE_2D, texture.id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    uploadCompressedImage(GL_TEXTURE_2D, data.compressed, streamer);
+    glState().bindTexture(GL_TEXTURE_2D, 0);
+}
+
+//Textures keyed by file path so each image is decoded and uploaded once
+class TextureCache {
+public:
+    std::unordered_map<std::string, Texture*> textures;
+    AssetPipeline* pipeline = NULL;     //Decode on its workers when set, otherwise load in place
+    TextureStreamer* streamer = NULL;   //Upload through its PBO ring when set
+    bool compress = false;              //Upload BC1/BC3/BC5 from the .btex cache. Needs S3TC support
+
+    //Returns the texture for a file, loading it on first use. Needs a current GL context.
+    //With a pipeline the GL name is valid right away and the image arrives once it is uploaded
+    // @param path - String of the texture file location
+    // @param normalMap - Compressed as BC5, which keeps X and Y only
+    Texture* acquire(const std::string& path, bool normalMap = false) {
+        std::unordered_map<std::string, Texture*>::iterator found = textures.find(path);
+        if (found == textures.end()) {
+            Texture* texture = new Texture();
+            texture->path = path;
+            glGenTextures(1, &texture->id);
+            found = textures.insert(std::make_pair(path, texture)).first;
+
+            std::shared_ptr<TextureData> image(new TextureData());
+            bool compressed = compress;
+            if (pipeline) {
+                texture->loading = true;
+                pipeline->submit([path, image, normalMap, compressed] { loadTextureData(path, true, normalMap, compressed, *image); },
+                    [this, texture, image] {
+                        texture->loading = false;
+                        if (texture->refCount == 0)
+                            destroy(texture);   //Released while decoding
+                        else
+                            uploadTexture(*texture, *image, streamer);
+                    });
+            }
+            else if (loadTextureData(path, true, normalMap, compressed, *image))
+                uploadTexture(*texture, *image, streamer);
+        }
+        found->second->refCount++;
+        return found->second;
+    }
+
+    //Drops one reference. The last one deletes the GL texture
+    void release(Texture* texture) {
+        if (!texture || --texture->refCount > 0)
+            return;
+        textures.erase(texture->path);
+        if (!texture->loading)
+            destroy(texture);   //Otherwise the pipeline's upload step frees it
+    }
+
+private:
+    void destroy(Texture* texture) {
+        if (texture->id) {
+            glState().deletedTexture(texture->id);
+            glDeleteTextures(1, &texture->id);
+        }
+        delete texture;
+    }
+};
+
+#endif
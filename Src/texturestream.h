@@ -0,0 +1,116 @@
+#ifndef TEXTURE_STREAM_FILE
+#define TEXTURE_STREAM_FILE
+
+#include <glad/glad.h>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+#define STREAM_SLOTS 3                  //Uploads in flight before the oldest must have finished
+#define STREAM_SLOT_BYTES (16 << 20)    //Fits a 2048x2048 RGBA image. Bigger ones upload directly
+#define STREAM_WAIT_NS 1000000          //Fence poll interval when the ring is full
+
+//Ring of persistently mapped pixel unpack buffers. Pixels are copied into a free slot and
+//glTexImage2D reads them from the buffer, so the call returns without the driver copying client memory.
+//A fence per slot keeps the CPU from overwriting a slot the GPU hasn't consumed yet
+class TextureStreamer {
+public:
+    GLuint buffer = 0;
+    unsigned char* mapped = NULL;
+    size_t slotSize = 0;
+    int slotCount = 0;
+    int streamed = 0, direct = 0, stalls = 0;   //Uploads through the ring, uploads too big for it, waits on a busy slot
+
+    //Creates and maps the ring. Needs GL 4.4 or ARB_buffer_storage, otherwise every upload stays direct
+    // @param slotBytes - Largest image that can be streamed
+    // @param slots - Number of slots
+    bool create(size_t slotBytes = STREAM_SLOT_BYTES, int slots = STREAM_SLOTS) {
+        if (!GLAD_GL_VERSION_4_4 && !GLAD_GL_ARB_buffer_storage)
+            return false;
+
+        slotSize = slotBytes;
+        slotCount = slots;
+        fences.assign(slots, (GLsync)0);
+        next = 0;
+        active = -1;
+
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)(slotSize * slotCount), NULL, flags);
+        mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)(slotSize * slotCount), flags);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (!mapped) {
+            destroy();
+            return false;
+        }
+        return true;
+    }
+
+    //Copies pixels into the next slot and binds the ring as the unpack source
+    // @param pixels - Data for the next glTexImage2D / glTexSubImage2D
+    // @param bytes - Size of the data
+    // @param source - Receives what to pass as the upload's data pointer (a buffer offset when streamed)
+    // @returns False when the data goes straight from client memory. source is left as pixels then
+    bool stage(const void* pixels, size_t bytes, const void*& source) {
+        source = pixels;
+        if (!mapped || bytes > slotSize) {
+            direct++;
+            return false;
+        }
+
+        int slot = next;
+        next = (next + 1) % slotCount;
+        if (fences[slot]) {
+            GLenum state = glClientWaitSync(fences[slot], 0, 0);
+            if (state == GL_TIMEOUT_EXPIRED) {
+                stalls++;
+                while (state == GL_TIMEOUT_EXPIRED)
+                    state = glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, STREAM_WAIT_NS);
+            }
+            glDeleteSync(fences[slot]);
+            fences[slot] = 0;
+        }
+
+        size_t offset = slotSize * slot;
+        std::memcpy(mapped + offset, pixels, bytes);    //Coherent mapping, visible to the GPU without a flush
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        source = (const void*)(uintptr_t)offset;
+        active = slot;
+        streamed++;
+        return true;
+    }
+
+    //Fences the slot used by the last stage() once its upload calls are issued
+    void commit() {
+        if (active < 0)
+            return;
+        fences[active] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        active = -1;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    void destroy() {
+        for (size_t i = 0; i < fences.size(); i++)
+            if (fences[i])
+                glDeleteSync(fences[i]);
+        fences.clear();
+        if (buffer) {
+            if (mapped) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            }
+            glDeleteBuffers(1, &buffer);
+        }
+        buffer = 0;
+        mapped = NULL;
+    }
+
+private:
+    std::vector<GLsync> fences;
+    int next = 0;
+    int active = -1;    //Slot staged but not committed yet
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef UNIFORM_BUFFER_FILE
+#define UNIFORM_BUFFER_FILE
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstring>
+#include <cstddef>
+
+//Per frame camera state. Matches the std140 FrameData block in the shaders
+struct FrameBlock {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec3 cameraPos;
+    float padding;          //vec3 takes a full 16 byte slot in std140
+};
+
+//Active light. Matches the std140 LightData block. Each float fills the gap after a vec3
+struct LightBlock {
+    glm::vec3 lightPos;
+    float ambientStr;
+    glm::vec3 lightColor;
+    float specStr;
+    glm::vec3 ambientColor;
+    float specPhong;
+    glm::vec3 playerFacing; //Spotlight direction
+    float padding;
+};
+
+static_assert(offsetof(FrameBlock, projection) == 64 && offsetof(FrameBlock, cameraPos) == 128 && sizeof(FrameBlock) == 144,
+    "FrameBlock must follow std140");
+static_assert(offsetof(LightBlock, lightColor) == 16 && offsetof(LightBlock, ambientColor) == 32 &&
+    offsetof(LightBlock, playerFacing) == 48 && sizeof(LightBlock) == 64, "LightBlock must follow std140");
+
+//Uniform buffer attached to a fixed binding point so every program using the block reads the same data.
+//Updates that don't change anything are skipped
+class UniformBuffer {
+public:
+    GLuint buffer = 0;
+    GLuint binding = 0;
+
+    //Allocates the buffer and attaches it to its binding point
+    // @param bindingPoint - UniformBlockId the shaders' block is bound to
+    // @param size - Bytes of the block
+    void create(GLuint bindingPoint, size_t size) {
+        binding = bindingPoint;
+        last.assign(size, 0);
+        valid = false;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)size, NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+    }
+
+    //Uploads the whole block when it differs from the last upload
+    void update(const void* data, size_t size) {
+        if (!buffer || size != last.size())
+            return;
+        if (valid && std::memcmp(last.data(), data, size) == 0)
+            return;
+        std::memcpy(last.data(), data, size);
+        valid = true;
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, (GLsizeiptr)size, data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void destroy() {
+        if (buffer)
+            glDeleteBuffers(1, &buffer);
+        buffer = 0;
+        valid = false;
+    }
+
+private:
+    std::vector<unsigned char> last;    //Copy of what the GPU has
+    bool valid = false;
+};
+
+#endif
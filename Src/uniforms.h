@@ -0,0 +1,140 @@
+#ifndef UNIFORMS_FILE
+#define UNIFORMS_FILE
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <string>
+#include <cstring>
+
+//Every uniform the shaders use. Programs that lack one just ignore its setter
+enum UniformId {
+    UNIFORM_TRANSFORM,
+    UNIFORM_TEX0,
+    UNIFORM_NORM_TEX,
+    UNIFORM_TEX2,
+    UNIFORM_BLEND_MODE,
+    UNIFORM_LIGHTING_MODE,
+    UNIFORM_PACKED_VERTEX,
+    UNIFORM_BOUNDS_MIN,
+    UNIFORM_BOUNDS_EXTENT,
+    UNIFORM_INSTANCED,
+    UNIFORM_SKYBOX,
+    UNIFORM_COUNT
+};
+
+//GLSL names, in UniformId order
+static const char* const uniformNames[UNIFORM_COUNT] = {
+    "transform",
+    "tex0",
+    "norm_tex",
+    "tex2",
+    "blendMode",
+    "lightingMode",
+    "packedVertex",
+    "boundsMin",
+    "boundsExtent",
+    "instanced",
+    "skybox"
+};
+
+//Uniform blocks shared by every program. The id is also the binding point
+enum UniformBlockId {
+    UNIFORM_BLOCK_FRAME,    //View, projection and camera position
+    UNIFORM_BLOCK_LIGHT,    //Active light
+    UNIFORM_BLOCK_COUNT
+};
+
+static const char* const uniformBlockNames[UNIFORM_BLOCK_COUNT] = {
+    "FrameData",
+    "LightData"
+};
+
+//Locations of one program's active uniforms, looked up once after linking, plus the last value sent to each.
+//Uniform blocks the program declares are attached to their fixed binding points at the same time.
+//Setters write to the bound program and skip the GL call when the value hasn't changed
+class UniformTable {
+public:
+    int uploads = 0, skipped = 0;   //glUniform calls made and avoided
+
+    //Reads the program's active uniforms and maps them to their UniformId
+    void reflect(GLuint program) {
+        for (int block = 0; block < UNIFORM_BLOCK_COUNT; block++) {
+            GLuint index = glGetUniformBlockIndex(program, uniformBlockNames[block]);
+            if (index != GL_INVALID_INDEX)
+                glUniformBlockBinding(program, index, (GLuint)block);
+        }
+
+        for (int id = 0; id < UNIFORM_COUNT; id++) {
+            slots[id].location = -1;
+            slots[id].valid = false;
+        }
+
+        GLint count = 0, longest = 0;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &longest);
+        std::string name(longest > 0 ? longest : 1, '\0');
+        for (GLint i = 0; i < count; i++) {
+            GLsizei length = 0;
+            GLint size;
+            GLenum type;
+            glGetActiveUniform(program, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, &name[0]);
+            std::string uniform(name.c_str(), length);
+            size_t bracket = uniform.find('[');
+            if (bracket != std::string::npos)
+                uniform.resize(bracket);    //Arrays report "name[0]"
+            for (int id = 0; id < UNIFORM_COUNT; id++)
+                if (uniform == uniformNames[id]) {
+                    slots[id].location = glGetUniformLocation(program, uniformNames[id]);
+                    break;
+                }
+        }
+    }
+
+    bool has(UniformId id) const { return slots[id].location >= 0; }
+
+    void set(UniformId id, int value) {
+        if (changed(id, &value, sizeof(value)))
+            glUniform1i(slots[id].location, value);
+    }
+
+    void set(UniformId id, float value) {
+        if (changed(id, &value, sizeof(value)))
+            glUniform1f(slots[id].location, value);
+    }
+
+    void set(UniformId id, const glm::vec3& value) {
+        if (changed(id, glm::value_ptr(value), sizeof(value)))
+            glUniform3fv(slots[id].location, 1, glm::value_ptr(value));
+    }
+
+    void set(UniformId id, const glm::mat4& value) {
+        if (changed(id, glm::value_ptr(value), sizeof(value)))
+            glUniformMatrix4fv(slots[id].location, 1, GL_FALSE, glm::value_ptr(value));
+    }
+
+private:
+    struct Slot {
+        GLint location = -1;
+        bool valid = false;             //value holds what the program has
+        unsigned char value[64];        //Big enough for a mat4
+    };
+    Slot slots[UNIFORM_COUNT];
+
+    //Stores the value and reports whether it needs uploading
+    bool changed(UniformId id, const void* value, size_t size) {
+        Slot& slot = slots[id];
+        if (slot.location < 0)
+            return false;   //Not in this program
+        if (slot.valid && std::memcmp(slot.value, value, size) == 0) {
+            skipped++;
+            return false;
+        }
+        std::memcpy(slot.value, value, size);
+        slot.valid = true;
+        uploads++;
+        return true;
+    }
+};
+
+#endif
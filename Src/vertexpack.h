@@ -0,0 +1,130 @@
+#ifndef VERTEX_PACK_FILE
+#define VERTEX_PACK_FILE
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cfloat>
+#include <cmath>
+
+//20 byte vertex. The float layout is 56
+struct PackedVertex {
+    uint16_t position[4];   //XYZ as unorm16 inside the mesh bounds, W unused (keeps the next field aligned)
+    int16_t normal[2];      //Octahedral snorm16
+    uint16_t uv[2];         //Half floats
+    int8_t tangent[4];      //XYZ snorm8, W = bitangent handedness (+-127)
+};
+
+//Rounds a float to the nearest half float
+inline uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+    int exponent = (int)((bits >> 23) & 0xff);
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if (exponent == 0xff)
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);  //Inf or NaN
+    exponent += 15 - 127;
+    if (exponent >= 31)
+        return sign | 0x7c00;   //Too big, clamp to infinity
+    if (exponent <= 0) {
+        if (exponent < -10)
+            return sign;        //Too small, flush to zero
+        mantissa |= 0x800000;   //Denormal, shift the implicit 1 in
+        int shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1)
+            half++;
+        return sign | (uint16_t)half;
+    }
+    uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000)
+        half++;                 //Round. A carry into the exponent is still correct
+    return sign | (uint16_t)half;
+}
+
+inline int16_t floatToSnorm16(float value) {
+    return (int16_t)std::round(glm::clamp(value, -1.f, 1.f) * 32767.f);
+}
+
+inline int8_t floatToSnorm8(float value) {
+    return (int8_t)std::round(glm::clamp(value, -1.f, 1.f) * 127.f);
+}
+
+//Maps a unit vector onto the octahedron unfolded into [-1,1]^2
+inline glm::vec2 octEncode(glm::vec3 n) {
+    n /= std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    glm::vec2 encoded(n.x, n.y);
+    if (n.z < 0.f) {
+        encoded.x = (1.f - std::abs(n.y)) * (n.x >= 0.f ? 1.f : -1.f);
+        encoded.y = (1.f - std::abs(n.x)) * (n.y >= 0.f ? 1.f : -1.f);
+    }
+    return encoded;
+}
+
+//Same as the shader's octDecode
+inline glm::vec3 octDecode(glm::vec2 e) {
+    glm::vec3 n(e.x, e.y, 1.f - std::abs(e.x) - std::abs(e.y));
+    float t = std::max(-n.z, 0.f);
+    n.x += n.x >= 0.f ? -t : t;
+    n.y += n.y >= 0.f ? -t : t;
+    return glm::normalize(n);
+}
+
+//Quantizes interleaved float vertices (XYZ, normal XYZ, UV, tan XYZ, bitan XYZ) into PackedVertex
+// @param vertices - Float vertex data
+// @param vertexCount - Number of vertices
+// @param stride - Floats per vertex
+// @param boundsMin - Receives the position that maps to 0
+// @param boundsExtent - Receives the size that maps to 65535
+inline void packVertices(const GLfloat* vertices, int vertexCount, int stride,
+    glm::vec3& boundsMin, glm::vec3& boundsExtent, std::vector<PackedVertex>& out) {
+    boundsMin = glm::vec3(FLT_MAX);
+    glm::vec3 boundsMax(-FLT_MAX);
+    for (int v = 0; v < vertexCount; v++) {
+        glm::vec3 pos(vertices[v * stride], vertices[v * stride + 1], vertices[v * stride + 2]);
+        boundsMin = glm::min(boundsMin, pos);
+        boundsMax = glm::max(boundsMax, pos);
+    }
+    if (vertexCount == 0)
+        boundsMin = boundsMax = glm::vec3(0.f);
+    boundsExtent = boundsMax - boundsMin;
+    glm::vec3 toUnit;
+    for (int k = 0; k < 3; k++)
+        toUnit[k] = boundsExtent[k] > 0.f ? 65535.f / boundsExtent[k] : 0.f;
+
+    out.resize(vertexCount);
+    for (int v = 0; v < vertexCount; v++) {
+        const GLfloat* src = &vertices[v * stride];
+        PackedVertex& dst = out[v];
+
+        for (int k = 0; k < 3; k++)
+            dst.position[k] = (uint16_t)std::round((src[k] - boundsMin[k]) * toUnit[k]);
+        dst.position[3] = 0;
+
+        glm::vec3 normal(src[3], src[4], src[5]);
+        float normalLength = glm::length(normal);
+        glm::vec2 oct = normalLength > 0.f ? octEncode(normal / normalLength) : glm::vec2(0.f);
+        dst.normal[0] = floatToSnorm16(oct.x);
+        dst.normal[1] = floatToSnorm16(oct.y);
+
+        dst.uv[0] = floatToHalf(src[6]);
+        dst.uv[1] = floatToHalf(src[7]);
+
+        //The shader rebuilds the bitangent as cross(N, T) * handedness
+        glm::vec3 tangent(src[8], src[9], src[10]);
+        glm::vec3 bitangent(src[11], src[12], src[13]);
+        float tangentLength = glm::length(tangent);
+        if (tangentLength > 0.f)
+            tangent /= tangentLength;
+        for (int k = 0; k < 3; k++)
+            dst.tangent[k] = floatToSnorm8(tangent[k]);
+        dst.tangent[3] = glm::dot(glm::cross(normal, tangent), bitangent) < 0.f ? -127 : 127;
+    }
+}
+
+#endif